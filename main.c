@@ -23,34 +23,96 @@
 #include <time.h>
 #include <getopt.h>
 #include <stdint.h>
-#include <sys/select.h>
+#include <stddef.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+/* USDT probes (provider "mouse_tool") for perf/bpftrace; compiled in when <sys/sdt.h>
+   is available unless built with -DMOUSE_TOOL_NO_SDT. An unattached probe is a nop.
+   Timestamps passed to probes are session-clock ns (CLOCK_MONOTONIC by default,
+   comparable with bpftrace's nsecs). */
+#if !defined(MOUSE_TOOL_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MT_HAVE_SDT 1
+#endif
+#endif
+#ifdef MT_HAVE_SDT
+#define MT_PROBE1(n, a) STAP_PROBE1(mouse_tool, n, a)
+#define MT_PROBE2(n, a, b) STAP_PROBE2(mouse_tool, n, a, b)
+#define MT_PROBE4(n, a, b, c, d) STAP_PROBE4(mouse_tool, n, a, b, c, d)
+#define MT_PROBE5(n, a, b, c, d, e) STAP_PROBE5(mouse_tool, n, a, b, c, d, e)
+#else
+#define MT_PROBE1(n, a) ((void)0)
+#define MT_PROBE2(n, a, b) ((void)0)
+#define MT_PROBE4(n, a, b, c, d) ((void)0)
+#define MT_PROBE5(n, a, b, c, d, e) ((void)0)
+#endif
 
 #define SGR_BUF 128
+#define INBUF_SIZE 4096
+#define TK_SEQ_MAX 64
+#define PASTE_MAX 65536
+#define ESC_WAIT 0.05
 #define MAX_EVENTS 65536
+#define HIST_CHUNK 65536     /* JSON history grows by whole chunks of this many events */
+#define HIST_CHUNKS 16384
 #define MULTICLICK_MAX_GAP 0.5
 #define MULTICLICK_RADIUS 3
+#define TTY_MAX 16
 
-static struct termios orig_tio;
 /* default: use stdin fd (original behaviour). May be replaced with /dev/tty if needed. */
 static int ttyfd = STDIN_FILENO;
+/* input terminals: source 0 is ttyfd unless --tty is given, then every --tty PATH is a
+   source in command-line order. Each keeps its own saved attributes for restore. */
+struct tty {
+	int fd;
+	int owned;              /* opened by us (/dev/tty or --tty) */
+	int raw;                /* attributes changed; orig must be restored */
+	struct termios orig;
+	const char *path;
+};
+static struct tty ttys[TTY_MAX];
+static int ntty = 0;
+static int tty_tagged = 0;  /* --tty given: tag output with the source id */
 static volatile sig_atomic_t got_sig = 0;
 static volatile sig_atomic_t cleanup_done = 0;
 
-typedef enum { EVT_PRESS=1, EVT_MOTION=2, EVT_RELEASE=3 } evtype_t;
-typedef struct { int x,y; int button; evtype_t type; struct timespec t; } event_t;
+typedef enum { EVT_PRESS=1, EVT_MOTION=2, EVT_RELEASE=3, EVT_SCROLL=4, EVT_KEY=5, EVT_FOCUS=6, EVT_PASTE=7, EVT_DWELL=8 } evtype_t;
+/* key: key id for EVT_KEY, 1/0 (in/out) for EVT_FOCUS, byte count for EVT_PASTE, 1/0 (start/end) for EVT_DWELL.
+   delta/vel: EVT_SCROLL lines (negative = up/left) and coalesced velocity in lines/s;
+   EVT_DWELL milliseconds at rest.
+   t: nanoseconds on the session clock (see ts_now_ns)
+   src: index of the terminal the event came from (see ttys) */
+typedef struct { int x,y; int button; evtype_t type; int key, mods; int delta; float vel; uint64_t t; int src; } event_t;
 typedef struct { event_t ev; double dt; } out_event_t;
 
 static FILE *out_fp = NULL;
+/* extra streaming outputs attached at runtime (control "sink add") */
+#define SINK_MAX 8
+static struct { FILE *fp; char path[256]; } sinks[SINK_MAX];
+static int nsinks = 0;
 static int do_mark = 0;
 static int no_warn = 0;
+static int want_keys = 0;   /* emit key and paste tokens (--keys) */
+static int want_focus = 0;  /* emit focus in/out tokens (--focus) */
 
 /* output modes */
 enum { OUT_CSV = 0, OUT_JSON = 1, OUT_PRETTY = 2, OUT_JSONL = 3 };
+static int out_mode = OUT_CSV;
 
 /* formatted error/warn */
 static void print_error(int code, const char *fmt, ...)
@@ -71,20 +133,20 @@ static void print_warn(const char *fmt, ...)
 	va_end(ap);
 }
 
-/* helper: write terminal sequences to the terminal fd.
-   If ttyfd is still the default STDIN_FILENO, write to STDOUT_FILENO
+/* helper: write terminal sequences to source s.
+   If its fd is the default STDIN_FILENO, write to STDOUT_FILENO
    (this preserves original behavior when stdout is a terminal). */
-static ssize_t term_write(const char *buf, size_t len)
-{
-	int fd_to_use = (ttyfd == STDIN_FILENO) ? STDOUT_FILENO : ttyfd;
-	return write(fd_to_use, buf, len);
-}
+static int tty_out_fd(int s) { return ttys[s].fd == STDIN_FILENO ? STDOUT_FILENO : ttys[s].fd; }
+static ssize_t tty_write(int s, const char *buf, size_t len) { return write(tty_out_fd(s), buf, len); }
 
-/* minimal async-signal-safe restore */
+/* minimal async-signal-safe restore (write and tcsetattr only) on every source */
 static void minimal_signal_restore(void)
 {
-	const char seq[] = "\x1b[?25h\x1b[?1049l\x1b[?1000l\x1b[?1002l\x1b[?1006l";
-	term_write(seq, sizeof(seq)-1);
+	const char seq[] = "\x1b[?25h\x1b[?1049l\x1b[?1000l\x1b[?1002l\x1b[?1003l\x1b[?1006l\x1b[?1004l\x1b[?2004l";
+	for (int i = 0; i < ntty; ++i) {
+		tty_write(i, seq, sizeof(seq)-1);
+		if (ttys[i].raw) tcsetattr(ttys[i].fd, TCSANOW, &ttys[i].orig);
+	}
 }
 
 /* signal handlers */
@@ -103,16 +165,21 @@ static void restore_terminal(void)
 {
 	if (cleanup_done) return;
 	cleanup_done = 1;
-	/* use term_write for proper fd */
-	term_write("\x1b[?1000l\x1b[?1002l\x1b[?1006l", 24);
-	/* flush and restore attributes on ttyfd (if valid) */
-	if (ttyfd >= 0) tcflush(ttyfd, TCIFLUSH);
-	if (ttyfd >= 0) tcsetattr(ttyfd, TCSANOW, &orig_tio);
-	term_write("\x1b[?1049l", 8);
+	for (int i = 0; i < ntty; ++i) {
+		struct tty *t = &ttys[i];
+		tty_write(i, "\x1b[?1000l\x1b[?1002l\x1b[?1003l\x1b[?1006l\x1b[?25h", 38);
+		if (want_focus) tty_write(i, "\x1b[?1004l", 8);
+		if (want_keys) tty_write(i, "\x1b[?2004l", 8);
+		/* flush and restore the attributes saved for this terminal */
+		if (t->raw) { tcflush(t->fd, TCIFLUSH); tcsetattr(t->fd, TCSANOW, &t->orig); t->raw = 0; }
+		tty_write(i, "\x1b[?1049l", 8);
+	}
 	fflush(stdout);
-	if (out_fp && out_fp != stdout) fclose(out_fp);
-	/* close /dev/tty only if we opened it (i.e., ttyfd != STDIN_FILENO) */
-	if (ttyfd != STDIN_FILENO && ttyfd >= 0) { close(ttyfd); ttyfd = STDIN_FILENO; }
+	/* out_fp stays open: final dumps are written after restore; exit() closes it */
+	if (out_fp) fflush(out_fp);
+	for (int i = 0; i < nsinks; ++i) fclose(sinks[i].fp);
+	nsinks = 0;
+	/* terminals we opened stay open until exit so record playback can still draw on them */
 }
 
 /* install signals */
@@ -127,335 +194,5040 @@ static void install_signals(void)
 	sigaction(SIGWINCH, &sw, NULL);
 }
 
-/* enable mouse reporting */
-static void enable_mouse_reporting(int motion)
+/* enable mouse reporting on every source */
+static void enable_mouse_reporting(int motion)
+{
+	for (int i = 0; i < ntty; ++i) {
+		if (motion) tty_write(i, "\x1b[?1000h\x1b[?1002h\x1b[?1006h", 24);
+		else tty_write(i, "\x1b[?1000h\x1b[?1006h", 16);
+		/* focus reports and bracketed paste only when those tokens are wanted */
+		if (want_focus) tty_write(i, "\x1b[?1004h", 8);
+		if (want_keys) tty_write(i, "\x1b[?2004h", 8);
+		/* drain so sequences are sent */
+		tcdrain(tty_out_fd(i));
+	}
+}
+
+/* put every source in raw mode, saving its attributes first.
+   returns -1 (errno set, *bad = failing source) or 0 */
+static int tty_setup(int *bad)
+{
+	for (int i = 0; i < ntty; ++i) {
+		struct tty *t = &ttys[i];
+		*bad = i;
+		if (tcgetattr(t->fd, &t->orig) == -1) return -1;
+		struct termios tio = t->orig;
+		tio.c_lflag &= ~(ICANON | ECHO);
+		tio.c_cc[VMIN] = 1; tio.c_cc[VTIME] = 0;
+		t->raw = 1; /* set before the change: a partial failure still restores */
+		if (tcsetattr(t->fd, TCSANOW, &tio) == -1) return -1;
+	}
+	return 0;
+}
+
+/* timestamp service: events are stamped once per input read on the clock chosen
+   with --clock; CLOCK_REALTIME is sampled once at startup to anchor absolute times */
+enum { TS_MONOTONIC, TS_RAW, TS_BOOTTIME, TS_TSC, TS_VIRTUAL };
+static int ts_source = TS_MONOTONIC;
+static clockid_t ts_clockid = CLOCK_MONOTONIC;
+static int want_ts = 0; /* add absolute "ts" to every output (-T) */
+static struct { uint64_t tsc0, ns0; double ns_per_tick; } tsc_cal;
+static struct { uint64_t ns; int64_t real_ns; } ts_anchor;
+/* TS_VIRTUAL (--script): time only moves when the loop advances it, so every
+   deadline, gap and pacing decision is reproducible and costs no real waiting */
+static uint64_t vclock_ns;
+
+static uint64_t clock_ns(clockid_t id)
+{
+	struct timespec t; clock_gettime(id, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t rdtsc(void)
+{
+	unsigned lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+/* CPUID 0x80000007 EDX bit 8: TSC runs at a constant rate across P/C-states */
+static int tsc_invariant(void)
+{
+	unsigned a, b, c, d;
+	__asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0x80000000u), "c"(0));
+	if (a < 0x80000007u) return 0;
+	__asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0x80000007u), "c"(0));
+	return (d >> 8) & 1;
+}
+#endif
+
+static uint64_t ts_now_ns(void)
+{
+	if (ts_source == TS_VIRTUAL) return vclock_ns;
+#if defined(__x86_64__) || defined(__i386__)
+	if (ts_source == TS_TSC) return tsc_cal.ns0 + (uint64_t)((double)(rdtsc() - tsc_cal.tsc0) * tsc_cal.ns_per_tick);
+#endif
+	return clock_ns(ts_clockid);
+}
+
+/* --clock NAME; returns 0 for unknown names */
+static int ts_select(const char *name)
+{
+	if (!strcmp(name, "monotonic")) { ts_source = TS_MONOTONIC; ts_clockid = CLOCK_MONOTONIC; return 1; }
+#ifdef CLOCK_MONOTONIC_RAW
+	if (!strcmp(name, "raw")) { ts_source = TS_RAW; ts_clockid = CLOCK_MONOTONIC_RAW; return 1; }
+#endif
+#ifdef CLOCK_BOOTTIME
+	if (!strcmp(name, "boottime")) { ts_source = TS_BOOTTIME; ts_clockid = CLOCK_BOOTTIME; return 1; }
+#endif
+	if (!strcmp(name, "tsc")) { ts_source = TS_TSC; ts_clockid = CLOCK_MONOTONIC; return 1; }
+	return 0;
+}
+
+/* sleep on the session clock; the virtual clock just moves forward */
+static void ts_sleep(double sec)
+{
+	if (sec <= 0) return;
+	if (ts_source == TS_VIRTUAL) { vclock_ns += (uint64_t)(sec * 1e9); return; }
+	struct timespec ts = { .tv_sec = (time_t)sec, .tv_nsec = (long)((sec - (time_t)sec)*1e9) };
+	nanosleep(&ts, NULL);
+}
+
+/* calibrate the TSC against CLOCK_MONOTONIC (if selected) and take the realtime anchor */
+static void ts_init(void)
+{
+	if (ts_source == TS_VIRTUAL) {
+		/* fixed origin: virtual time 1 s is the unix epoch + 1 s */
+		vclock_ns = 1000000000ull; ts_anchor.ns = 0; ts_anchor.real_ns = 0;
+		return;
+	}
+	if (ts_source == TS_TSC) {
+#if defined(__x86_64__) || defined(__i386__)
+		if (!tsc_invariant()) { print_warn("TSC is not invariant; using monotonic clock"); ts_source = TS_MONOTONIC; }
+		else {
+			uint64_t n0 = clock_ns(CLOCK_MONOTONIC), c0 = rdtsc();
+			struct timespec cal = { .tv_sec = 0, .tv_nsec = 20000000L };
+			nanosleep(&cal, NULL);
+			uint64_t n1 = clock_ns(CLOCK_MONOTONIC), c1 = rdtsc();
+			tsc_cal.ns_per_tick = (double)(n1 - n0) / (double)(c1 - c0);
+			tsc_cal.tsc0 = c1; tsc_cal.ns0 = n1;
+		}
+#else
+		print_warn("TSC clock not available on this architecture; using monotonic clock");
+		ts_source = TS_MONOTONIC;
+#endif
+	}
+	/* anchor: keep the tightest of a few session/realtime/session samples */
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 3; ++i) {
+		uint64_t a = ts_now_ns(); uint64_t r = clock_ns(CLOCK_REALTIME); uint64_t b = ts_now_ns();
+		if (b - a < best) { best = b - a; ts_anchor.ns = a + (b - a) / 2; ts_anchor.real_ns = (int64_t)r; }
+	}
+}
+
+/* absolute (unix epoch) seconds of a session timestamp */
+static double ts_abs(uint64_t t)
+{
+	return ((double)ts_anchor.real_ns + ((double)t - (double)ts_anchor.ns)) * 1e-9;
+}
+
+/* ISO-8601 UTC of a session timestamp */
+static void ts_iso(uint64_t t, char *buf, size_t n)
+{
+	time_t sec = (time_t)ts_abs(t); struct tm g; gmtime_r(&sec, &g);
+	strftime(buf, n, "%Y-%m-%dT%H:%M:%SZ", &g);
+}
+
+/* session counters, shared by the --stats-interval line and the metrics endpoint */
+#define DT_BUCKETS 9
+static const double dt_bounds[DT_BUCKETS] = { 0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0 };
+#define BIND_BUCKETS 8
+static const double bind_bounds[BIND_BUCKETS] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.05 };
+static struct {
+	unsigned long long by_type[16];                /* events by evtype_t */
+	unsigned long long by_button[16];              /* presses by decoded button */
+	unsigned long long parse_errors, bytes_in, bytes_out, flushes, dropped;
+	unsigned long long deb_dup, deb_chatter, deb_repaired, deb_orphan;   /* --debounce rules */
+	unsigned long long filtered;                   /* events rejected by --filter */
+	unsigned long long bind_runs, bind_failed, bind_dropped, bind_nonzero;   /* --bind commands */
+	unsigned long long bind_hist[BIND_BUCKETS + 1]; /* event to spawn latency; last bucket is +Inf */
+	double bind_lat_sum, bind_lat_max;
+	unsigned long long dt_hist[DT_BUCKETS + 1];    /* inter-event interval; last bucket is +Inf */
+	unsigned long long dt_count;
+	double dt_sum;
+	size_t history;                                /* events held for the JSON dump */
+	uint64_t start, last_t;
+} stats;
+
+/* parse SGR "<Cb;Cx;CyM" */
+static int parse_sgr(const char *buf, size_t len, int *cb, int *cx, int *cy, char *termch)
+{
+	if (len < 4 || buf[0] != '<' || len >= SGR_BUF) return 0;
+	char tmp[SGR_BUF];
+	memcpy(tmp, buf+1, len-2);
+	tmp[len-2] = '\0';
+	char *p = tmp;
+	char *s1 = strchr(p,';'); if (!s1) return 0; *s1++ = '\0';
+	char *s2 = strchr(s1,';'); if (!s2) return 0; *s2++ = '\0';
+	errno = 0;
+	char *end;
+	long vcb = strtol(p,&end,10); if (errno || end==p) return 0;
+	long vcx = strtol(s1,&end,10); if (errno || end==s1) return 0;
+	long vcy = strtol(s2,&end,10); if (errno || end==s2) return 0;
+	*cb = (int)vcb; *cx = (int)vcx; *cy = (int)vcy; *termch = buf[len-1];
+	return 1;
+}
+
+/* keys reported by the input tokenizer; printable ASCII keeps its own code */
+enum {
+	KEY_UP = 0x100, KEY_DOWN, KEY_RIGHT, KEY_LEFT, KEY_HOME, KEY_END, KEY_INSERT, KEY_DELETE,
+	KEY_PGUP, KEY_PGDN, KEY_BACKTAB, KEY_ESC, KEY_TAB, KEY_BACKSPACE,
+	KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
+	KEY_LAST
+};
+static const char *const key_names[KEY_LAST - KEY_UP] = {
+	"up", "down", "right", "left", "home", "end", "insert", "delete",
+	"pageup", "pagedown", "backtab", "esc", "tab", "backspace",
+	"f1", "f2", "f3", "f4", "f5", "f6", "f7", "f8", "f9", "f10", "f11", "f12"
+};
+/* key modifier mask (xterm "1 + mask" parameter encoding) */
+enum { KMOD_SHIFT = 1, KMOD_ALT = 2, KMOD_CTRL = 4 };
+
+/* key name for output; ',' and ' ' get names so CSV stays parseable */
+static const char *key_name(int key, char *buf, size_t n)
+{
+	if (key >= KEY_UP && key < KEY_LAST) return key_names[key - KEY_UP];
+	if (key == ',') return "comma";
+	if (key == ' ') return "space";
+	snprintf(buf, n, "%c", (key > 0x20 && key < 0x7f) ? key : '?');
+	return buf;
+}
+
+/* tokenizer states, byte classes and actions.
+   The transition table packs (action << 4 | next state). */
+enum { ST_GROUND, ST_ESC, ST_CSI, ST_SS3, ST_OSC, ST_OSC_ESC, ST_N };
+enum { BC_CTRL, BC_CR, BC_BEL, BC_ESC, BC_INTER, BC_PARAM, BC_LBRACKET, BC_RBRACKET,
+	BC_O, BC_BSLASH, BC_FINAL, BC_DEL, BC_HIGH, BC_N };
+enum { A_NEXT, A_CHAR, A_CTRL, A_ENTER, A_ALT, A_LONE_ESC, A_CSI, A_SS3, A_STRING, A_DROP, A_IGNORE };
+#define TR(a, s) (unsigned char)(((a) << 4) | (s))
+
+static unsigned char tk_class[256];
+static const unsigned char tk_fsm[ST_N][BC_N] = {
+	[ST_GROUND] = {
+		[BC_CTRL] = TR(A_CTRL, ST_GROUND), [BC_CR] = TR(A_ENTER, ST_GROUND), [BC_BEL] = TR(A_CTRL, ST_GROUND),
+		[BC_ESC] = TR(A_NEXT, ST_ESC), [BC_INTER] = TR(A_CHAR, ST_GROUND), [BC_PARAM] = TR(A_CHAR, ST_GROUND),
+		[BC_LBRACKET] = TR(A_CHAR, ST_GROUND), [BC_RBRACKET] = TR(A_CHAR, ST_GROUND), [BC_O] = TR(A_CHAR, ST_GROUND),
+		[BC_BSLASH] = TR(A_CHAR, ST_GROUND), [BC_FINAL] = TR(A_CHAR, ST_GROUND), [BC_DEL] = TR(A_CTRL, ST_GROUND),
+		[BC_HIGH] = TR(A_IGNORE, ST_GROUND),
+	},
+	[ST_ESC] = {
+		[BC_CTRL] = TR(A_LONE_ESC, ST_GROUND), [BC_CR] = TR(A_LONE_ESC, ST_GROUND), [BC_BEL] = TR(A_LONE_ESC, ST_GROUND),
+		[BC_ESC] = TR(A_LONE_ESC, ST_GROUND), [BC_INTER] = TR(A_ALT, ST_GROUND), [BC_PARAM] = TR(A_ALT, ST_GROUND),
+		[BC_LBRACKET] = TR(A_NEXT, ST_CSI), [BC_RBRACKET] = TR(A_NEXT, ST_OSC), [BC_O] = TR(A_NEXT, ST_SS3),
+		[BC_BSLASH] = TR(A_ALT, ST_GROUND), [BC_FINAL] = TR(A_ALT, ST_GROUND), [BC_DEL] = TR(A_ALT, ST_GROUND),
+		[BC_HIGH] = TR(A_LONE_ESC, ST_GROUND),
+	},
+	[ST_CSI] = {
+		[BC_CTRL] = TR(A_DROP, ST_GROUND), [BC_CR] = TR(A_DROP, ST_GROUND), [BC_BEL] = TR(A_DROP, ST_GROUND),
+		[BC_ESC] = TR(A_LONE_ESC, ST_GROUND), [BC_INTER] = TR(A_NEXT, ST_CSI), [BC_PARAM] = TR(A_NEXT, ST_CSI),
+		[BC_LBRACKET] = TR(A_CSI, ST_GROUND), [BC_RBRACKET] = TR(A_CSI, ST_GROUND), [BC_O] = TR(A_CSI, ST_GROUND),
+		[BC_BSLASH] = TR(A_CSI, ST_GROUND), [BC_FINAL] = TR(A_CSI, ST_GROUND), [BC_DEL] = TR(A_DROP, ST_GROUND),
+		[BC_HIGH] = TR(A_DROP, ST_GROUND),
+	},
+	[ST_SS3] = {
+		[BC_CTRL] = TR(A_DROP, ST_GROUND), [BC_CR] = TR(A_DROP, ST_GROUND), [BC_BEL] = TR(A_DROP, ST_GROUND),
+		[BC_ESC] = TR(A_LONE_ESC, ST_GROUND), [BC_INTER] = TR(A_DROP, ST_GROUND), [BC_PARAM] = TR(A_NEXT, ST_SS3),
+		[BC_LBRACKET] = TR(A_SS3, ST_GROUND), [BC_RBRACKET] = TR(A_SS3, ST_GROUND), [BC_O] = TR(A_SS3, ST_GROUND),
+		[BC_BSLASH] = TR(A_SS3, ST_GROUND), [BC_FINAL] = TR(A_SS3, ST_GROUND), [BC_DEL] = TR(A_DROP, ST_GROUND),
+		[BC_HIGH] = TR(A_DROP, ST_GROUND),
+	},
+	[ST_OSC] = {
+		[BC_CTRL] = TR(A_NEXT, ST_OSC), [BC_CR] = TR(A_NEXT, ST_OSC), [BC_BEL] = TR(A_STRING, ST_GROUND),
+		[BC_ESC] = TR(A_NEXT, ST_OSC_ESC), [BC_INTER] = TR(A_NEXT, ST_OSC), [BC_PARAM] = TR(A_NEXT, ST_OSC),
+		[BC_LBRACKET] = TR(A_NEXT, ST_OSC), [BC_RBRACKET] = TR(A_NEXT, ST_OSC), [BC_O] = TR(A_NEXT, ST_OSC),
+		[BC_BSLASH] = TR(A_NEXT, ST_OSC), [BC_FINAL] = TR(A_NEXT, ST_OSC), [BC_DEL] = TR(A_NEXT, ST_OSC),
+		[BC_HIGH] = TR(A_NEXT, ST_OSC),
+	},
+	[ST_OSC_ESC] = {
+		[BC_CTRL] = TR(A_DROP, ST_GROUND), [BC_CR] = TR(A_DROP, ST_GROUND), [BC_BEL] = TR(A_DROP, ST_GROUND),
+		[BC_ESC] = TR(A_NEXT, ST_OSC_ESC), [BC_INTER] = TR(A_NEXT, ST_OSC), [BC_PARAM] = TR(A_NEXT, ST_OSC),
+		[BC_LBRACKET] = TR(A_NEXT, ST_OSC), [BC_RBRACKET] = TR(A_NEXT, ST_OSC), [BC_O] = TR(A_NEXT, ST_OSC),
+		[BC_BSLASH] = TR(A_STRING, ST_GROUND), [BC_FINAL] = TR(A_NEXT, ST_OSC), [BC_DEL] = TR(A_NEXT, ST_OSC),
+		[BC_HIGH] = TR(A_NEXT, ST_OSC),
+	},
+};
+
+/* CSI/SS3 final byte -> key, and CSI "N~" parameter -> key */
+static const unsigned short tk_final_keys[128] = {
+	['A'] = KEY_UP, ['B'] = KEY_DOWN, ['C'] = KEY_RIGHT, ['D'] = KEY_LEFT,
+	['H'] = KEY_HOME, ['F'] = KEY_END, ['Z'] = KEY_BACKTAB,
+	['P'] = KEY_F1, ['Q'] = KEY_F2, ['R'] = KEY_F3, ['S'] = KEY_F4,
+};
+static const unsigned short tk_tilde_keys[25] = {
+	[1] = KEY_HOME, [2] = KEY_INSERT, [3] = KEY_DELETE, [4] = KEY_END, [5] = KEY_PGUP, [6] = KEY_PGDN,
+	[7] = KEY_HOME, [8] = KEY_END, [11] = KEY_F1, [12] = KEY_F2, [13] = KEY_F3, [14] = KEY_F4,
+	[15] = KEY_F5, [17] = KEY_F6, [18] = KEY_F7, [19] = KEY_F8, [20] = KEY_F9, [21] = KEY_F10,
+	[23] = KEY_F11, [24] = KEY_F12,
+};
+
+static void tk_init(void)
+{
+	for (int c = 0; c < 256; ++c) {
+		unsigned char k;
+		if (c == 0x1b) k = BC_ESC;
+		else if (c == '\r' || c == '\n') k = BC_CR;
+		else if (c == 0x07) k = BC_BEL;
+		else if (c < 0x20) k = BC_CTRL;
+		else if (c < 0x30) k = BC_INTER;
+		else if (c < 0x40) k = BC_PARAM;
+		else if (c == '[') k = BC_LBRACKET;
+		else if (c == ']') k = BC_RBRACKET;
+		else if (c == 'O') k = BC_O;
+		else if (c == '\\') k = BC_BSLASH;
+		else if (c < 0x7f) k = BC_FINAL;
+		else if (c == 0x7f) k = BC_DEL;
+		else k = BC_HIGH;
+		tk_class[c] = k;
+	}
+}
+
+/* SGR Cb decoding: low bits + extension bits (64/128) give the button,
+   4/8/16 are shift/meta/ctrl (same order as KMOD_*), 32 flags motion */
+enum { CBF_MOTION = 1, CBF_WHEEL = 2 };
+struct cb_info { unsigned char button, mods, flags; };
+static struct cb_info cb_table[256];
+
+static void cb_init(void)
+{
+	for (int cb = 0; cb < 256; ++cb) {
+		struct cb_info *ci = &cb_table[cb];
+		ci->button = (unsigned char)((cb & 3) + ((cb >> 6) & 3) * 4);
+		ci->mods = (unsigned char)((cb >> 2) & 7);
+		ci->flags = ((cb & 32) ? CBF_MOTION : 0) | (((cb & 192) == 64) ? CBF_WHEEL : 0);
+	}
+}
+
+/* input tokens */
+enum { TK_MORE = 0, TK_MOUSE, TK_KEY, TK_FOCUS, TK_PASTE, TK_ENTER, TK_SKIP };
+
+/* buffered terminal input; bytes of a partial sequence stay here until completed */
+struct input {
+	unsigned char buf[INBUF_SIZE];
+	size_t r, w;
+	uint64_t t;           /* session time of the last read() */
+	int paste;            /* inside a bracketed paste */
+	size_t paste_len;     /* total pasted bytes (paste_buf keeps the first PASTE_MAX) */
+	char paste_buf[PASTE_MAX];
+};
+static struct input tins[TTY_MAX];   /* one per source */
+
+/* parse up to n numeric CSI parameters ("1;5"); missing ones are 0 */
+static int tk_params(const unsigned char *p, const unsigned char *e, int *out, int n)
+{
+	int k = 0; for (int i = 0; i < n; ++i) out[i] = 0;
+	for (; p < e; ++p) {
+		if (*p >= '0' && *p <= '9') { if (k < n && out[k] < 100000) out[k] = out[k]*10 + (*p - '0'); }
+		else if (*p == ';' || *p == ':') ++k;
+		else return -1; /* private marker or intermediate */
+	}
+	return k + 1;
+}
+
+static int tk_key(event_t *ev, int key, int mods)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->type = EVT_KEY; ev->key = key; ev->mods = mods;
+	return TK_KEY;
+}
+
+/* classify a complete CSI sequence; ps..pe are the parameter/intermediate bytes */
+static int tk_csi(struct input *in, event_t *ev, const unsigned char *ps, const unsigned char *pe, unsigned char fin)
+{
+	if (ps < pe && *ps == '<' && (fin == 'M' || fin == 'm')) {
+		int cb, x, y; char termch = 0;
+		if (!parse_sgr((const char *)ps, (size_t)(pe - ps) + 1, &cb, &x, &y, &termch)) {
+			MT_PROBE1(parse_fail, (int)(pe - ps) + 1);
+			stats.parse_errors++;
+			return TK_SKIP;
+		}
+		const struct cb_info *ci = &cb_table[cb & 0xff];
+		memset(ev, 0, sizeof(*ev));
+		ev->button = ci->button; ev->mods = ci->mods; ev->x = x; ev->y = y;
+		if (ci->flags & CBF_MOTION) ev->type = EVT_MOTION;
+		else if (termch == 'm') ev->type = EVT_RELEASE;
+		else if (ci->flags & CBF_WHEEL) {
+			/* wheel buttons: 4 up, 5 down, 6 left, 7 right */
+			ev->type = EVT_SCROLL; ev->delta = (ci->button & 1) ? 1 : -1;
+		}
+		else ev->type = EVT_PRESS;
+		MT_PROBE4(parse_ok, ev->x, ev->y, (int)ev->type, ev->button);
+		return TK_MOUSE;
+	}
+	int pv[2];
+	if (tk_params(ps, pe, pv, 2) < 0) return TK_SKIP;
+	int mods = pv[1] > 1 ? pv[1] - 1 : 0;
+	if (fin == '~') {
+		if (pv[0] == 200) { in->paste = 1; in->paste_len = 0; return TK_SKIP; }
+		if (pv[0] > 0 && pv[0] < (int)(sizeof(tk_tilde_keys)/sizeof(tk_tilde_keys[0])) && tk_tilde_keys[pv[0]])
+			return tk_key(ev, tk_tilde_keys[pv[0]], mods);
+		return TK_SKIP;
+	}
+	if ((fin == 'I' || fin == 'O') && ps == pe) {
+		memset(ev, 0, sizeof(*ev));
+		ev->type = EVT_FOCUS; ev->key = (fin == 'I');
+		return TK_FOCUS;
+	}
+	if (fin < 128 && tk_final_keys[fin]) return tk_key(ev, tk_final_keys[fin], mods);
+	return TK_SKIP;
+}
+
+/* inside a bracketed paste: collect bytes up to ESC[201~ */
+static int tk_paste(struct input *in, event_t *ev)
+{
+	static const unsigned char end[] = "\x1b[201~";
+	const size_t elen = sizeof(end) - 1;
+	size_t p = in->r, keep = in->w;
+	for (; p < in->w; ++p) {
+		if (in->buf[p] != 0x1b) continue;
+		size_t m = 0;
+		while (m < elen && p + m < in->w && in->buf[p+m] == end[m]) ++m;
+		if (m == elen) break;
+		if (p + m == in->w) { keep = p; p = in->w; break; } /* possible marker prefix at buffer end */
+	}
+	size_t stop = (p < in->w) ? p : keep;
+	for (size_t i = in->r; i < stop; ++i) {
+		if (in->paste_len < PASTE_MAX) in->paste_buf[in->paste_len] = (char)in->buf[i];
+		in->paste_len++;
+	}
+	in->r = stop;
+	if (p >= in->w) return TK_MORE;
+	in->r = p + elen; in->paste = 0;
+	memset(ev, 0, sizeof(*ev));
+	ev->type = EVT_PASTE; ev->key = (int)in->paste_len;
+	return TK_PASTE;
+}
+
+/* take one token from the buffered input; TK_MORE means a sequence is incomplete */
+static int tk_scan(struct input *in, event_t *ev)
+{
+	if (in->paste) return tk_paste(in, ev);
+	size_t start = in->r, p = start;
+	int st = ST_GROUND;
+	while (p < in->w) {
+		unsigned char c = in->buf[p];
+		unsigned char tr = tk_fsm[st][tk_class[c]];
+		st = tr & 0x0f;
+		switch (tr >> 4) {
+		case A_NEXT:
+			if (++p - start > TK_SEQ_MAX) { in->r = p; stats.parse_errors++; return TK_SKIP; }
+			continue;
+		case A_CHAR: in->r = p + 1; return tk_key(ev, c, 0);
+		case A_CTRL:
+			in->r = p + 1;
+			if (c == '\t') return tk_key(ev, KEY_TAB, 0);
+			if (c == 0x7f || c == 0x08) return tk_key(ev, KEY_BACKSPACE, 0);
+			return tk_key(ev, c == 0 ? ' ' : 'a' + c - 1, KMOD_CTRL);
+		case A_ENTER: in->r = p + 1; return TK_ENTER;
+		case A_ALT:
+			in->r = p + 1;
+			if (c == 0x7f) return tk_key(ev, KEY_BACKSPACE, KMOD_ALT);
+			return tk_key(ev, c, KMOD_ALT);
+		case A_LONE_ESC: in->r = p; return tk_key(ev, KEY_ESC, 0); /* c is rescanned */
+		case A_CSI: in->r = p + 1; return tk_csi(in, ev, in->buf + start + 2, in->buf + p, c);
+		case A_SS3:
+			in->r = p + 1;
+			if (c < 128 && tk_final_keys[c]) return tk_key(ev, tk_final_keys[c], 0);
+			return TK_SKIP;
+		case A_STRING: case A_DROP: case A_IGNORE: default:
+			in->r = p + 1; return TK_SKIP;
+		}
+	}
+	return TK_MORE;
+}
+
+/* nothing followed a partial sequence within ESC_WAIT: report ESC as a key, rescan the rest */
+static int tk_flush_esc(struct input *in, event_t *ev)
+{
+	if (in->paste || in->r >= in->w) return TK_MORE;
+	if (in->buf[in->r] != 0x1b) { in->r++; return TK_SKIP; }
+	in->r++;
+	return tk_key(ev, KEY_ESC, 0);
+}
+
+/* hierarchical timer wheel: TW_LEVELS levels of 64 slots, 1 ms ticks at level 0.
+   Arm/cancel are O(1) list operations; the read loop sleeps until tw_next_ms(). */
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 5
+
+struct timer {
+	struct timer *next, *prev;
+	uint64_t expires;                 /* absolute ms on the wheel clock */
+	void (*fn)(struct timer *);
+	int armed;
+};
+static struct {
+	struct timer slots[TW_LEVELS][TW_SLOTS];   /* list heads */
+	uint64_t occupied[TW_LEVELS];               /* bit per non-empty slot */
+	uint64_t now;                               /* last processed tick */
+	uint64_t base_ns;
+	int ready;
+} tw;
+
+/* timer callbacks ask the read loop to return: wake -> 0 (timeout), stop -> 2 (soft stop) */
+static int loop_wake = 0, loop_stop = 0;
+
+static uint64_t tw_clock_ms(void)
+{
+	return (ts_now_ns() - tw.base_ns) / 1000000u;
+}
+
+static void tw_init(void)
+{
+	if (tw.ready) return;
+	for (int l = 0; l < TW_LEVELS; ++l)
+		for (int i = 0; i < TW_SLOTS; ++i) tw.slots[l][i].next = tw.slots[l][i].prev = &tw.slots[l][i];
+	tw.base_ns = ts_now_ns() - 1000000000ull; /* keep tick 0 in the past */
+	tw.now = tw_clock_ms();
+	tw.ready = 1;
+}
+
+static void tw_place(struct timer *t)
+{
+	uint64_t delta = t->expires - tw.now;
+	int l = 0;
+	while (l + 1 < TW_LEVELS && delta >= ((uint64_t)1 << (TW_BITS * (l + 1)))) ++l;
+	unsigned idx = (unsigned)(t->expires >> (TW_BITS * l)) & TW_MASK;
+	if (delta >= ((uint64_t)1 << (TW_BITS * (l + 1)))) idx = (unsigned)((tw.now >> (TW_BITS * l)) - 1) & TW_MASK; /* beyond range: park in the last slot */
+	struct timer *h = &tw.slots[l][idx];
+	t->next = h->next; t->prev = h; h->next->prev = t; h->next = t;
+	tw.occupied[l] |= (uint64_t)1 << idx;
+}
+
+static void timer_cancel(struct timer *t)
+{
+	if (!t->armed) return;
+	t->prev->next = t->next; t->next->prev = t->prev;
+	t->armed = 0;
+	/* the occupied bit is cleared lazily when the slot is processed */
+}
+
+/* arm (or re-arm) t to fire ms milliseconds from now */
+static void timer_arm(struct timer *t, uint64_t ms, void (*fn)(struct timer *))
+{
+	timer_cancel(t);
+	tw_init();
+	t->expires = tw_clock_ms() + (ms ? ms : 1);
+	if (t->expires <= tw.now) t->expires = tw.now + 1;
+	t->fn = fn; t->armed = 1;
+	tw_place(t);
+}
+
+/* move every timer of one slot: fire the due ones at level 0, re-place the rest */
+static void tw_run_slot(int l, unsigned idx)
+{
+	struct timer *h = &tw.slots[l][idx];
+	struct timer pending = { .next = &pending, .prev = &pending };
+	if (h->next == h) { tw.occupied[l] &= ~((uint64_t)1 << idx); return; }
+	/* detach the whole list first so callbacks may re-arm safely */
+	pending.next = h->next; pending.prev = h->prev;
+	pending.next->prev = &pending; pending.prev->next = &pending;
+	h->next = h->prev = h;
+	tw.occupied[l] &= ~((uint64_t)1 << idx);
+	while (pending.next != &pending) {
+		struct timer *t = pending.next;
+		t->prev->next = t->next; t->next->prev = t->prev;
+		if (t->expires <= tw.now) { t->armed = 0; t->fn(t); }
+		else tw_place(t);
+	}
+}
+
+static void tw_cascade(int l)
+{
+	unsigned idx = (unsigned)(tw.now >> (TW_BITS * l)) & TW_MASK;
+	if (idx == 0 && l + 1 < TW_LEVELS) tw_cascade(l + 1);
+	tw_run_slot(l, idx);
+}
+
+/* advance the wheel to the current time, firing due timers; empty ticks are skipped */
+static void tw_expire(void)
+{
+	if (!tw.ready) return;
+	uint64_t to = tw_clock_ms();
+	while (tw.now < to) {
+		unsigned cur = (unsigned)tw.now & TW_MASK;
+		uint64_t next = (tw.now | TW_MASK) + 1; /* next cascade boundary */
+		uint64_t m = (cur == TW_MASK) ? 0 : tw.occupied[0] & (~(uint64_t)0 << (cur + 1));
+		if (m) next = (tw.now & ~(uint64_t)TW_MASK) + (uint64_t)__builtin_ctzll(m);
+		if (next > to) { tw.now = to; break; }
+		tw.now = next;
+		if ((tw.now & TW_MASK) == 0) tw_cascade(1);
+		tw_run_slot(0, (unsigned)tw.now & TW_MASK);
+	}
+}
+
+/* milliseconds until the wheel needs attention, -1 if no timer is armed */
+static long long tw_next_ms(void)
+{
+	if (!tw.ready) return -1;
+	int any = 0;
+	for (int l = 0; l < TW_LEVELS; ++l) if (tw.occupied[l]) any = 1;
+	if (!any) return -1;
+	unsigned cur = (unsigned)tw.now & TW_MASK;
+	uint64_t next = (tw.now | TW_MASK) + 1;
+	uint64_t occ = tw.occupied[0];
+	uint64_t m = (cur == TW_MASK) ? 0 : occ & (~(uint64_t)0 << (cur + 1));
+	if (m) next = (tw.now & ~(uint64_t)TW_MASK) + (uint64_t)__builtin_ctzll(m);
+	uint64_t now = tw_clock_ms();
+	return next > now ? (long long)(next - now) : 0;
+}
+
+/* event loop fd registry: the terminals and auxiliary sockets (metrics, ...) share one
+   epoll set; handlers run inside read_sgr_event_timeout() and must never block */
+struct watch {
+	int fd;
+	void (*fn)(struct watch *w, uint32_t events);
+};
+static int loop_epfd = -1;
+
+static int loop_ctl(int op, struct watch *w, uint32_t events)
+{
+	if (loop_epfd < 0) {
+		loop_epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (loop_epfd < 0) return -1;
+	}
+	struct epoll_event ee; memset(&ee, 0, sizeof(ee));
+	ee.events = events; ee.data.ptr = w;
+	return epoll_ctl(loop_epfd, op, w->fd, &ee);
+}
+static int loop_add(struct watch *w, uint32_t events) { return loop_ctl(EPOLL_CTL_ADD, w, events); }
+static int loop_mod(struct watch *w, uint32_t events) { return loop_ctl(EPOLL_CTL_MOD, w, events); }
+static void loop_del(struct watch *w) { if (loop_epfd >= 0 && w->fd >= 0) epoll_ctl(loop_epfd, EPOLL_CTL_DEL, w->fd, NULL); }
+
+static int script_wait(double wait);
+
+/* wait up to wait seconds (<0: forever) and run the handlers of ready fds.
+   returns the number of ready fds, -1 on error */
+static int loop_wait(double wait)
+{
+	if (ts_source == TS_VIRTUAL) return script_wait(wait);
+	int ms = wait < 0 ? -1 : (int)(wait * 1000.0 + 0.999);
+	struct epoll_event evs[16];
+	int n = epoll_wait(loop_epfd, evs, 16, ms);
+	for (int i = 0; i < n; ++i) {
+		struct watch *w = evs[i].data.ptr;
+		w->fn(w, evs[i].events);
+	}
+	return n;
+}
+
+/* terminal sources on the loop: a readable terminal appends to its own buffer, stamped
+   once per read; a terminal that hangs up is dropped and the others keep running */
+static struct watch tty_watches[TTY_MAX];
+static int tty_live = 0;   /* sources still registered */
+static int tty_rr = 0;     /* next source to scan first */
+
+static void tty_read_fn(struct watch *w, uint32_t events)
+{
+	(void)events;
+	int s = (int)(w - tty_watches);
+	struct input *in = &tins[s];
+	if (in->r > 0) { memmove(in->buf, in->buf + in->r, in->w - in->r); in->w -= in->r; in->r = 0; }
+	ssize_t r = read(w->fd, in->buf + in->w, sizeof(in->buf) - in->w);
+	if (r < 0 && (errno == EINTR || errno == EAGAIN)) return;
+	if (r <= 0) {
+		loop_del(w); w->fd = -1; tty_live--;
+		if (tty_tagged && tty_live) print_warn("tty %d (%s) closed, %d left", s, ttys[s].path, tty_live);
+		return;
+	}
+	in->t = ts_now_ns(); /* the one clock read for every token of this chunk */
+	MT_PROBE2(input_read, (long)r, in->t);
+	stats.bytes_in += (unsigned long long)r;
+	in->w += (size_t)r;
+}
+
+static int tty_watch_start(void)
+{
+	for (int i = 0; i < ntty; ++i) {
+		tty_watches[i].fd = ttys[i].fd; tty_watches[i].fn = tty_read_fn;
+		if (loop_add(&tty_watches[i], EPOLLIN) < 0) return -1;
+		tty_live++;
+	}
+	return 0;
+}
+
+/* scripted input (--script FILE) on the virtual clock. Each line "+MS BYTES" delivers
+   BYTES (escapes \e \r \n \t \\ \xHH) MS milliseconds after the previous line; "+MS"
+   alone only lets time pass; '#' starts a comment. It replaces the terminals as source 0. */
+static struct {
+	unsigned char *bytes;                       /* decoded input of all lines */
+	struct script_chunk { uint64_t at; size_t off, len; } *chunks;
+	size_t n, next;
+} script;
+
+/* load and decode FILE; returns 0, or -1 with a message in err. A first pass sizes
+   both arrays (decoded bytes never outnumber the file's) and the line buffer (its
+   longest line), so loading allocates the same whatever the script's length */
+static int script_load(const char *path, char *err, size_t errn)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) { snprintf(err, errn, "%s", strerror(errno)); return -1; }
+	char buf[8192]; size_t cap = 1, used = 0, ccap = 1, lineno = 0, r, cur = 0, longest = 0;
+	while ((r = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		cap += r;
+		for (size_t i = 0; i < r; ++i) {
+			if (buf[i] != '\n') { cur++; continue; }
+			ccap++;
+			if (cur > longest) longest = cur;
+			cur = 0;
+		}
+	}
+	if (cur > longest) longest = cur;
+	rewind(fp);
+	size_t linecap = longest + 2;   /* newline and NUL: getline() never has to grow it */
+	char *line = malloc(linecap);
+	script.bytes = malloc(cap); script.chunks = malloc(ccap * sizeof(*script.chunks));
+	if (!line || !script.bytes || !script.chunks) { snprintf(err, errn, "out of memory"); free(line); fclose(fp); return -1; }
+	uint64_t at = 1000000000ull; /* virtual start, see ts_init() */
+	while (getline(&line, &linecap, fp) != -1) {
+		++lineno;
+		char *p = line; p += strspn(p, " \t");
+		if (*p == '#' || *p == '\n' || !*p) continue;
+		char *end;
+		double ms = *p == '+' ? strtod(p + 1, &end) : -1.0;
+		if (ms < 0 || end == p + 1) { snprintf(err, errn, "line %zu: expected \"+MS [BYTES]\"", lineno); free(line); fclose(fp); return -1; }
+		at += (uint64_t)(ms * 1e6);
+		p = end; if (*p == ' ' || *p == '\t') ++p;
+		if (script.n == ccap) { snprintf(err, errn, "file changed while loading"); free(line); fclose(fp); return -1; }
+		struct script_chunk *c = &script.chunks[script.n++];
+		c->at = at; c->off = used;
+		for (; *p && *p != '\n'; ++p) {
+			if (used == cap) { snprintf(err, errn, "file changed while loading"); free(line); fclose(fp); return -1; }
+			unsigned char b = (unsigned char)*p;
+			if (b == '\\' && p[1]) {
+				++p;
+				if (*p == 'e') b = 0x1b; else if (*p == 'r') b = '\r'; else if (*p == 'n') b = '\n'; else if (*p == 't') b = '\t';
+				else if (*p == 'x' && p[1] && p[2]) { char h[3] = { p[1], p[2], 0 }; b = (unsigned char)strtol(h, NULL, 16); p += 2; }
+				else b = (unsigned char)*p;
+			}
+			script.bytes[used++] = b;
+		}
+		c->len = used - c->off;
+	}
+	free(line);
+	fclose(fp);
+	return 0;
+}
+
+/* loop_wait() on the virtual clock: jump to the next script chunk if it is due within
+   wait, else to the end of wait; the script running out is EOF once nothing else is
+   pending. Auxiliary fds (control, metrics) are still polled without blocking. */
+static int script_wait(double wait)
+{
+	if (loop_epfd >= 0) {
+		struct epoll_event evs[16];
+		int n = epoll_wait(loop_epfd, evs, 16, 0);
+		for (int i = 0; i < n; ++i) { struct watch *w = evs[i].data.ptr; w->fn(w, evs[i].events); }
+		if (n > 0) return n;
+	}
+	uint64_t until = wait < 0 ? UINT64_MAX : vclock_ns + (uint64_t)(wait * 1e9 + 0.5);
+	if (script.next == script.n) {
+		if (wait < 0) { tty_live = 0; return 0; }
+		vclock_ns = until;
+		return 0;
+	}
+	struct script_chunk *c = &script.chunks[script.next];
+	if (c->at > until) { vclock_ns = until; return 0; }
+	if (c->at > vclock_ns) vclock_ns = c->at;
+	struct input *in = &tins[0];
+	if (in->r > 0) { memmove(in->buf, in->buf + in->r, in->w - in->r); in->w -= in->r; in->r = 0; }
+	size_t k = sizeof(in->buf) - in->w;
+	if (k > c->len) k = c->len;
+	memcpy(in->buf + in->w, script.bytes + c->off, k);
+	c->off += k; c->len -= k;
+	if (!c->len) script.next++;
+	in->w += k; in->t = vclock_ns;
+	stats.bytes_in += k;
+	return 1;
+}
+
+/* next wanted token buffered for source s (esc: flush a stale partial sequence as ESC first).
+   returns 1 event, 2 Enter, 0 when more bytes are needed */
+static int tty_next(int s, event_t *ev, int esc)
+{
+	struct input *in = &tins[s];
+	for (;;) {
+		int k = esc ? tk_flush_esc(in, ev) : tk_scan(in, ev);
+		esc = 0;
+		if (k == TK_MORE) return 0;
+		if (k == TK_ENTER) return 2;
+		if (k == TK_MOUSE || ((k == TK_KEY || k == TK_PASTE) && want_keys) || (k == TK_FOCUS && want_focus)) {
+			ev->t = in->t; ev->src = s;
+			return 1;
+		}
+	}
+}
+
+/* read next input token from any source; return codes:
+   1 -> event (mouse, or key/focus/paste when enabled)
+   0 -> timeout (or a timer asked for a wakeup)
+  -1 -> EOF/error on every source (or signal set)
+   2 -> Enter pressed (or a timer requested a soft stop)
+*/
+static int read_sgr_event_timeout(event_t *ev, double timeout_sec, int want_motion)
+{
+	(void)want_motion;
+	const uint64_t esc_ns = (uint64_t)(ESC_WAIT * 1e9);
+	uint64_t deadline = 0;
+	if (timeout_sec >= 0) deadline = ts_now_ns() + (uint64_t)(timeout_sec * 1e9);
+	for (;;) {
+		/* buffered tokens first, round-robin so one busy terminal cannot starve the rest */
+		for (int n = 0; n < ntty; ++n) {
+			int s = (tty_rr + n) % ntty;
+			int rv = tty_next(s, ev, 0);
+			if (rv) { tty_rr = (s + 1) % ntty; return rv; }
+		}
+		if (!tty_live) return -1;
+
+		/* need more bytes: run due timers, then wait until the nearest of the caller's
+		   deadline, ESC_WAIT after a partial sequence, or the next timer */
+		tw_expire();
+		if (loop_stop) { loop_stop = 0; return 2; }
+		if (loop_wake) { loop_wake = 0; return 0; }
+		uint64_t now = ts_now_ns();
+		double wait = -1.0;
+		if (timeout_sec >= 0) wait = deadline > now ? (double)(deadline - now) * 1e-9 : 0.0;
+		for (int s = 0; s < ntty; ++s) {
+			struct input *in = &tins[s];
+			if (in->r >= in->w || in->paste) continue;
+			double w = in->t + esc_ns > now ? (double)(in->t + esc_ns - now) * 1e-9 : 0.0;
+			if (wait < 0 || w < wait) wait = w;
+		}
+		long long tmo = tw_next_ms();
+		if (tmo >= 0 && (wait < 0 || tmo * 1e-3 < wait)) wait = tmo * 1e-3;
+		if (loop_wait(wait) < 0) {
+			if (errno == EINTR) { if (got_sig) return -1; continue; }
+			return -1;
+		}
+		/* partial sequences that saw no further byte within ESC_WAIT */
+		now = ts_now_ns();
+		for (int s = 0; s < ntty; ++s) {
+			struct input *in = &tins[s];
+			if (in->r >= in->w || in->paste || now < in->t + esc_ns) continue;
+			int rv = tty_next(s, ev, 1);
+			if (rv) return rv;
+		}
+		if (timeout_sec >= 0 && now >= deadline) return 0;
+	}
+}
+
+/* scroll coalescer: wheel reports inside one frame (--scroll-coalesce MS) are merged
+   into a single scroll event carrying the summed delta and its velocity (lines/s).
+   The frame end is a wheel timer, so a burst is flushed on time without further input. */
+static double scroll_frame = 0.0;
+static struct {
+	event_t pend; int have_pend;   /* burst being accumulated */
+	event_t next; int next_rv;     /* token that ended the burst, delivered on the next call */
+	int have_next;
+	struct timer frame;
+} sc;
+
+static void scroll_frame_fn(struct timer *t) { (void)t; loop_wake = 1; }
+
+static int scroll_flush(event_t *ev)
+{
+	timer_cancel(&sc.frame);
+	*ev = sc.pend; sc.have_pend = 0;
+	ev->vel = (float)(ev->delta / scroll_frame);
+	return 1;
+}
+
+/* coalescing stage of read_event() */
+static int read_event_coalesced(event_t *ev, double timeout_sec, int want_motion)
+{
+	if (scroll_frame <= 0.0) return read_sgr_event_timeout(ev, timeout_sec, want_motion);
+	for (;;) {
+		event_t e; int rv;
+		if (sc.have_next) { e = sc.next; rv = sc.next_rv; sc.have_next = 0; }
+		else {
+			rv = read_sgr_event_timeout(&e, timeout_sec, want_motion);
+			if (rv == 0 && sc.have_pend) {
+				/* frame over; if the wakeup was someone else's, deliver it next */
+				if (sc.frame.armed) { sc.next_rv = 0; sc.have_next = 1; }
+				return scroll_flush(ev);
+			}
+		}
+		if (rv == 1 && e.type == EVT_SCROLL) {
+			if (sc.have_pend && (sc.pend.button & ~1) == (e.button & ~1)
+				&& (double)(e.t - sc.pend.t) * 1e-9 <= scroll_frame) {
+				sc.pend.delta += e.delta; sc.pend.x = e.x; sc.pend.y = e.y;
+				continue;
+			}
+			if (!sc.have_pend) {
+				sc.pend = e; sc.have_pend = 1;
+				timer_arm(&sc.frame, (uint64_t)(scroll_frame * 1000.0 + 0.5), scroll_frame_fn);
+				continue;
+			}
+		}
+		if (sc.have_pend) { sc.next = e; sc.next_rv = rv; sc.have_next = 1; return scroll_flush(ev); }
+		*ev = e;
+		return rv;
+	}
+}
+
+/* debounce stage (--debounce MS[,DUP]) between coalescing and counting, so -n and the
+   multiclick logic only see clean press/release pairs:
+   - duplicate: a press, release or motion equal to the previous one (position, button,
+     mods, source) within DUP ms (default MS) is dropped
+   - chatter: a release is held for MS; a press of the same button before that cancels
+     both, otherwise the release goes out when the timer fires or the next event arrives
+   - repair: a press of a button that is already down gets the missing release first,
+     and a release of a button that is not down is dropped
+   Every rule has its own counter (stats line, metrics). */
+static uint64_t debounce_ns = 0, debounce_dup_ns = 0;
+static struct {
+	event_t last; int have_last;      /* previous raw mouse event, for duplicates */
+	event_t rel; int have_rel;        /* release held back for the chatter check */
+	event_t next; int next_rv, have_next;
+	uint16_t down[TTY_MAX];           /* buttons down per source */
+	struct timer timer;
+} db;
+
+static void debounce_fn(struct timer *t) { (void)t; loop_wake = 1; }
+
+static int db_same(const event_t *a, const event_t *b)
+{
+	return a->type == b->type && a->x == b->x && a->y == b->y && a->button == b->button && a->mods == b->mods && a->src == b->src;
+}
+
+static int read_event_debounced(event_t *ev, double timeout_sec, int want_motion)
+{
+	if (!debounce_ns) return read_event_coalesced(ev, timeout_sec, want_motion);
+	for (;;) {
+		event_t e; int rv, queued = db.have_next;
+		if (queued) { e = db.next; rv = db.next_rv; db.have_next = 0; }
+		else rv = read_event_coalesced(&e, timeout_sec, want_motion);
+		if (db.have_rel && (rv != 0 || !db.timer.armed)) {
+			/* held release is due: on its deadline, or before anything else */
+			int chatter = rv == 1 && e.type == EVT_PRESS && e.button == db.rel.button && e.src == db.rel.src && e.t - db.rel.t < debounce_ns;
+			timer_cancel(&db.timer);
+			db.have_rel = 0;
+			if (chatter) { stats.deb_chatter++; continue; }
+			db.down[db.rel.src] &= (uint16_t)~(1u << (db.rel.button & 15));
+			if (rv != 0) { db.next = e; db.next_rv = rv; db.have_next = 1; }
+			*ev = db.rel;
+			return 1;
+		}
+		if (rv != 1) { *ev = e; return rv; }
+		if (e.type == EVT_PRESS || e.type == EVT_RELEASE || e.type == EVT_MOTION) {
+			if (!queued && db.have_last && db_same(&e, &db.last) && e.t - db.last.t <= debounce_dup_ns) { stats.deb_dup++; continue; }
+			if (!queued) { db.last = e; db.have_last = 1; }
+		}
+		uint16_t bit = (uint16_t)(1u << (e.button & 15));
+		if (e.type == EVT_PRESS) {
+			if (db.down[e.src] & bit) {
+				stats.deb_repaired++;
+				db.down[e.src] &= (uint16_t)~bit;
+				db.next = e; db.next_rv = 1; db.have_next = 1;
+				e.type = EVT_RELEASE;
+				*ev = e;
+				return 1;
+			}
+			db.down[e.src] |= bit;
+		} else if (e.type == EVT_RELEASE) {
+			if (!(db.down[e.src] & bit)) { stats.deb_orphan++; continue; }
+			db.rel = e; db.have_rel = 1;
+			timer_arm(&db.timer, (debounce_ns + 999999) / 1000000, debounce_fn);
+			continue;
+		}
+		*ev = e;
+		return rv;
+	}
+}
+
+/* session timers: --idle-timeout / --max-duration / record length stop the loop softly,
+   --flush-interval batches output flushes, --stats-interval prints counters to stderr */
+static double idle_timeout = 0.0, max_duration = 0.0;
+static uint64_t flush_interval_ms = 0, stats_interval_ms = 0;
+static struct timer idle_timer, max_timer, record_timer, flush_timer, stats_timer;
+
+static void stop_fn(struct timer *t) { (void)t; loop_stop = 1; }
+
+/* per-event flush unless --flush-interval batches it */
+static void out_flush(FILE *fp)
+{
+	if (flush_interval_ms) return;
+	fflush(fp);
+	stats.flushes++;
+	MT_PROBE1(output_flush, 0);
+}
+
+static void flush_fn(struct timer *t)
+{
+	fflush(out_fp ? out_fp : stdout);
+	for (int i = 0; i < nsinks; ++i) fflush(sinks[i].fp);
+	stats.flushes++;
+	MT_PROBE1(output_flush, 1);
+	timer_arm(t, flush_interval_ms, flush_fn);
+}
+
+/* one-line counter summary (--stats-interval, control "stats") */
+static int stats_format(char *buf, size_t n)
+{
+	double up = (double)(ts_now_ns() - stats.start) * 1e-9;
+	unsigned long long events = 0;
+	for (int i = 0; i < 16; ++i) events += stats.by_type[i];
+	int w = snprintf(buf, n, "uptime=%.1fs events=%llu presses=%llu scrolls=%llu keys=%llu rate=%.1f/s",
+		up, events, stats.by_type[EVT_PRESS], stats.by_type[EVT_SCROLL], stats.by_type[EVT_KEY] + stats.by_type[EVT_PASTE],
+		up > 0 ? events / up : 0.0);
+	if (debounce_ns && w > 0 && (size_t)w < n)
+		w += snprintf(buf + w, n - (size_t)w, " debounce: duplicate=%llu chatter=%llu repaired=%llu orphan=%llu",
+			stats.deb_dup, stats.deb_chatter, stats.deb_repaired, stats.deb_orphan);
+	if (stats.bind_runs + stats.bind_failed + stats.bind_dropped && w > 0 && (size_t)w < n)
+		w += snprintf(buf + w, n - (size_t)w, " bind: runs=%llu failed=%llu dropped=%llu nonzero=%llu latency_avg=%.3fms latency_max=%.3fms",
+			stats.bind_runs, stats.bind_failed, stats.bind_dropped, stats.bind_nonzero,
+			stats.bind_runs ? stats.bind_lat_sum * 1e3 / (double)stats.bind_runs : 0.0, stats.bind_lat_max * 1e3);
+	return w;
+}
+
+static void stats_fn(struct timer *t)
+{
+	char line[512];
+	stats_format(line, sizeof(line));
+	fprintf(stderr, "\x1b[36m(stats)\x1b[0m %s\n", line);
+	timer_arm(t, stats_interval_ms, stats_fn);
+}
+
+static void session_timers_start(double record_seconds)
+{
+	stats.start = ts_now_ns();
+	if (idle_timeout > 0) timer_arm(&idle_timer, (uint64_t)(idle_timeout * 1000.0), stop_fn);
+	if (max_duration > 0) timer_arm(&max_timer, (uint64_t)(max_duration * 1000.0), stop_fn);
+	if (record_seconds > 0) timer_arm(&record_timer, (uint64_t)(record_seconds * 1000.0), stop_fn);
+	if (flush_interval_ms) timer_arm(&flush_timer, flush_interval_ms, flush_fn);
+	if (stats_interval_ms) timer_arm(&stats_timer, stats_interval_ms, stats_fn);
+}
+
+/* read next event: coalescing, counters and idle re-arm; same return codes as read_sgr_event_timeout */
+static int read_event(event_t *ev, double timeout_sec, int want_motion)
+{
+	int rv = read_event_debounced(ev, timeout_sec, want_motion);
+	if (rv != 1) return rv;
+	stats.by_type[ev->type & 15]++;
+	if (ev->type == EVT_PRESS) stats.by_button[ev->button & 15]++;
+	if (stats.last_t && ev->t >= stats.last_t) {
+		double dt = (double)(ev->t - stats.last_t) * 1e-9;
+		int b = 0; while (b < DT_BUCKETS && dt > dt_bounds[b]) ++b;
+		stats.dt_hist[b]++; stats.dt_count++; stats.dt_sum += dt;
+	}
+	stats.last_t = ev->t;
+	if (idle_timeout > 0) timer_arm(&idle_timer, (uint64_t)(idle_timeout * 1000.0), stop_fn);
+	return rv;
+}
+
+/* dwell detector (--dwell R,MS): the pointer rests while it stays within R cells of the
+   point where it stopped (the anchor). A positioned mouse event outside that radius moves
+   the anchor and re-arms a wheel timer for MS, so detection costs O(1) per event and a
+   dwell starts exactly on time with no further input. The timer queues a "start" event
+   stamped at the deadline; the next move out of the radius queues "end" with the whole
+   time at rest. Finished dwells are summed per --dwell-cell block in an open-addressing
+   hash of DW_CELLS slots, allocated once at startup and filled to at most 3/4, so the
+   streaming path never allocates; blocks past that are counted as dropped. The hash is
+   reported by control "dwell" and written to --dwell-map FILE at exit. */
+#define DW_CELLS 8192
+static int dwell_r = 0, dwell_cw = 8, dwell_ch = 4;
+static uint64_t dwell_ms = 0;
+static const char *dwell_map = NULL;
+struct dw_cell { int cx, cy; uint64_t ms; unsigned long long n; };
+static struct {
+	int have, on, x, y, src; uint64_t t0;   /* anchor; on: the dwell has started */
+	struct timer timer; int fired;
+	event_t q[3]; int qh, qn, rv;          /* events due before the next read, then rv */
+	struct dw_cell *cells; size_t cap, used;
+	uint64_t total_ms; unsigned long long count, dropped;   /* dropped: dwells of blocks that did not fit */
+} dw;
+
+static void dwell_fn(struct timer *t) { (void)t; dw.fired = 1; loop_wake = 1; }
+
+static void dw_push(int start, uint64_t t, uint64_t ms)
+{
+	event_t *e = &dw.q[(dw.qh + dw.qn++) % 3];
+	memset(e, 0, sizeof(*e));
+	e->type = EVT_DWELL; e->key = start; e->x = dw.x; e->y = dw.y; e->src = dw.src; e->t = t;
+	e->delta = ms > 0x7fffffff ? 0x7fffffff : (int)ms;
+	stats.by_type[EVT_DWELL]++;
+}
+
+static int dw_init(void)
+{
+	dw.cells = calloc(DW_CELLS, sizeof(*dw.cells));
+	if (!dw.cells) return -1;
+	dw.cap = DW_CELLS;
+	return 0;
+}
+
+static void dw_add(int cx, int cy, uint64_t ms)
+{
+	size_t h = ((size_t)cx * 73856093u ^ (size_t)cy * 19349663u) & (dw.cap - 1);
+	while (dw.cells[h].n && (dw.cells[h].cx != cx || dw.cells[h].cy != cy)) h = (h + 1) & (dw.cap - 1);
+	if (!dw.cells[h].n) {
+		if (dw.used >= dw.cap / 4 * 3) { dw.dropped++; return; }
+		dw.cells[h].cx = cx; dw.cells[h].cy = cy; dw.used++;
+	}
+	dw.cells[h].ms += ms; dw.cells[h].n++;
+}
+
+/* close the running dwell at t: totals, hash, and optionally an "end" event */
+static void dw_end(uint64_t t, int emit)
+{
+	uint64_t ms = t > dw.t0 ? (t - dw.t0) / 1000000u : 0;
+	if (emit) dw_push(0, t, ms);
+	dw.total_ms += ms; dw.count++;
+	dw_add((dw.x - 1) / dwell_cw, (dw.y - 1) / dwell_ch, ms);
+	dw.on = 0;
+}
+
+static void dw_track(const event_t *ev)
+{
+	int dx = ev->x - dw.x, dy = ev->y - dw.y;
+	if (dw.have && ev->src == dw.src && dx * dx + dy * dy <= dwell_r * dwell_r) return;
+	if (dw.on) dw_end(ev->t, 1);
+	dw.have = 1; dw.x = ev->x; dw.y = ev->y; dw.src = ev->src; dw.t0 = ev->t;
+	timer_arm(&dw.timer, dwell_ms, dwell_fn);
+}
+
+/* read_event() plus the dwell events; the main loop reads through this */
+static int read_event_dwell(event_t *ev, double timeout_sec, int want_motion)
+{
+	if (!dwell_ms) return read_event(ev, timeout_sec, want_motion);
+	if (!dw.qn && dw.rv) { int rv = dw.rv; dw.rv = 0; return rv; }
+	if (!dw.qn) {
+		int rv = read_event(ev, timeout_sec, want_motion);
+		if (dw.fired) {
+			dw.fired = 0;
+			if (dw.have && !dw.on) { dw.on = 1; dw_push(1, dw.t0 + dwell_ms * 1000000u, dwell_ms); }
+		}
+		if (rv == 1 && ev->type <= EVT_SCROLL) dw_track(ev);
+		if (!dw.qn) return rv;
+		if (rv == 1) dw.q[(dw.qh + dw.qn++) % 3] = *ev;
+		else if (rv != 0) dw.rv = rv;
+	}
+	*ev = dw.q[dw.qh]; dw.qh = (dw.qh + 1) % 3; dw.qn--;
+	return 1;
+}
+
+static int dw_cmp(const void *a, const void *b)
+{
+	const struct dw_cell *x = a, *y = b;
+	return x->ms < y->ms ? 1 : x->ms > y->ms ? -1 : 0;
+}
+
+/* end of session: count the dwell still running and write --dwell-map as CSV
+   "X0,Y0,X1,Y1,SECONDS,DWELLS", longest first */
+static void dwell_finish(void)
+{
+	if (!dwell_ms) return;
+	timer_cancel(&dw.timer);
+	if (dw.on) dw_end(ts_now_ns(), 0);
+	if (dw.dropped) print_warn("dwell map full: %llu dwells in blocks past %d were not kept per block", dw.dropped, DW_CELLS / 4 * 3);
+	if (dwell_map) {
+		FILE *fp = fopen(dwell_map, "w");
+		if (!fp) print_warn("cannot write dwell map '%s': %s", dwell_map, strerror(errno));
+		else {
+			size_t n = 0;
+			for (size_t i = 0; i < dw.cap; ++i) if (dw.cells[i].n) dw.cells[n++] = dw.cells[i];
+			qsort(dw.cells, n, sizeof(*dw.cells), dw_cmp);
+			for (size_t i = 0; i < n; ++i) {
+				const struct dw_cell *c = &dw.cells[i];
+				fprintf(fp, "%d,%d,%d,%d,%.3f,%llu\n", c->cx * dwell_cw + 1, c->cy * dwell_ch + 1,
+					(c->cx + 1) * dwell_cw, (c->cy + 1) * dwell_ch, (double)c->ms / 1000.0, c->n);
+			}
+			if (fclose(fp) != 0) print_warn("cannot write dwell map '%s': %s", dwell_map, strerror(errno));
+		}
+	}
+	free(dw.cells); dw.cells = NULL; dw.cap = dw.used = 0;
+}
+
+/* action dispatcher (--bind "REGION TRIGGER COMMAND", repeatable, or --bind @FILE with one
+   binding per line). REGION is X0,Y0,X1,Y1 (inclusive cells) or *; TRIGGER is a button
+   (left, middle, right or 0-15) with an optional :N click count, scroll-up/down/left/right,
+   drag-up/down/left/right (press and release BIND_DRAG or more cells apart, the region is
+   tested at the press) or dwell. The first binding that matches runs COMMAND with /bin/sh -c
+   through posix_spawn, so the loop never waits on fork or on the command; at most
+   --bind-jobs commands run at once and up to BIND_QUEUE more wait for a free slot. Children
+   are reaped when SIGCHLD wakes the event loop through a self-pipe (under --script, where
+   the loop only follows the virtual clock, by a polling timer). Dispatch latency is
+   measured from the event stamp to the return of posix_spawn. */
+#define BIND_MAX 64
+#define BIND_JOBS_MAX 32
+#define BIND_QUEUE 64
+#define BIND_DRAG 3
+enum { BT_CLICK, BT_SCROLL, BT_DRAG, BT_DWELL };
+enum { BD_UP, BD_DOWN, BD_LEFT, BD_RIGHT };
+struct binding {
+	int any, x0, y0, x1, y1;   /* region, any: * */
+	int trig, button, count;   /* button -1: any; count 0: any click of a run */
+	int dir;
+	char *cmd;
+};
+static struct binding binds[BIND_MAX];
+static int nbinds = 0, bind_jobs = 4;
+static struct {
+	pid_t job[BIND_JOBS_MAX];           /* running commands, 0: free slot */
+	int running;
+	int pipe[2];                        /* SIGCHLD self-pipe */
+	struct watch w;
+	struct { int b, clicks; event_t ev; } queue[BIND_QUEUE];
+	int qh, qn;
+	struct timer poll;
+	event_t press; int clicks;          /* current multiclick run */
+	short down_x[TTY_MAX][16], down_y[TTY_MAX][16];   /* press positions for drags, 0: none */
+} bd;
+
+static const char *const bind_dirs[4] = { "up", "down", "left", "right" };
+
+/* parse one binding; returns NULL or an error message */
+static const char *bind_parse(const char *spec)
+{
+	while (*spec == ' ' || *spec == '\t') ++spec;
+	if (nbinds == BIND_MAX) return "too many bindings";
+	struct binding b; memset(&b, 0, sizeof(b));
+	char region[64], trig[32];
+	int n = 0;
+	if (sscanf(spec, "%63s %31s %n", region, trig, &n) != 2 || !spec[n]) return "expected REGION TRIGGER COMMAND";
+	char extra;
+	if (!strcmp(region, "*")) b.any = 1;
+	else if (sscanf(region, "%d,%d,%d,%d%c", &b.x0, &b.y0, &b.x1, &b.y1, &extra) != 4 || b.x0 < 1 || b.y0 < 1 || b.x1 < b.x0 || b.y1 < b.y0)
+		return "region must be X0,Y0,X1,Y1 (1-based, inclusive) or *";
+	b.button = -1;
+	if (!strcmp(trig, "dwell")) b.trig = BT_DWELL;
+	else if (!strncmp(trig, "scroll-", 7) || !strncmp(trig, "drag-", 5)) {
+		const char *d = strchr(trig, '-') + 1;
+		b.trig = trig[0] == 's' ? BT_SCROLL : BT_DRAG;
+		b.dir = -1;
+		for (int i = 0; i < 4; ++i) if (!strcmp(d, bind_dirs[i])) b.dir = i;
+		if (b.dir < 0) return "direction must be up, down, left or right";
+	} else {
+		char *colon = strchr(trig, ':');
+		if (colon) {
+			char *end; long c = strtol(colon + 1, &end, 10);
+			if (end == colon + 1 || *end || c < 1 || c > 16) return "click count must be 1-16";
+			b.count = (int)c; *colon = '\0';
+		}
+		b.trig = BT_CLICK;
+		if (!strcmp(trig, "left")) b.button = 0;
+		else if (!strcmp(trig, "middle")) b.button = 1;
+		else if (!strcmp(trig, "right")) b.button = 2;
+		else if (strcmp(trig, "any")) {
+			char *end; long v = strtol(trig, &end, 10);
+			if (end == trig || *end || v < 0 || v > 15) return "unknown trigger";
+			b.button = (int)v;
+		}
+	}
+	size_t len = strlen(spec + n);
+	while (len && (spec[n + len - 1] == '\n' || spec[n + len - 1] == '\r')) --len;
+	if (!(b.cmd = malloc(len + 1))) return "out of memory";
+	memcpy(b.cmd, spec + n, len); b.cmd[len] = '\0';
+	binds[nbinds++] = b;
+	return NULL;
+}
+
+/* --bind @FILE: one binding per line, blank lines and # comments skipped */
+static int bind_load(const char *path, char *err, size_t errn)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) { snprintf(err, errn, "%s", strerror(errno)); return -1; }
+	char line[4096]; int ln = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		++ln;
+		char *p = line; while (*p == ' ' || *p == '\t') ++p;
+		if (*p == '#' || *p == '\n' || *p == '\r' || !*p) continue;
+		const char *e = bind_parse(p);
+		if (e) { snprintf(err, errn, "line %d: %s", ln, e); fclose(fp); return -1; }
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int bind_need_motion(void)
+{
+	for (int i = 0; i < nbinds; ++i) if (binds[i].trig == BT_DRAG) return 1;
+	return 0;
+}
+
+static void bind_start(int b, const event_t *e, int clicks);
+
+/* reap finished commands without blocking and start queued ones in the freed slots */
+static void bind_reap(void)
+{
+	for (int i = 0; i < bind_jobs; ++i) {
+		int st;
+		if (!bd.job[i] || waitpid(bd.job[i], &st, WNOHANG) != bd.job[i]) continue;
+		if (!WIFEXITED(st) || WEXITSTATUS(st)) stats.bind_nonzero++;
+		bd.job[i] = 0; bd.running--;
+	}
+	while (bd.qn && bd.running < bind_jobs) {
+		int q = bd.qh; bd.qh = (bd.qh + 1) % BIND_QUEUE; bd.qn--;
+		bind_start(bd.queue[q].b, &bd.queue[q].ev, bd.queue[q].clicks);
+	}
+}
+
+static void sigchld_handler(int sig)
+{
+	(void)sig;
+	int e = errno;
+	if (write(bd.pipe[1], "", 1) < 0) { /* pipe full: a wakeup is already pending */ }
+	errno = e;
+}
+
+static void bind_pipe_fn(struct watch *w, uint32_t events)
+{
+	(void)events;
+	char buf[64];
+	while (read(w->fd, buf, sizeof(buf)) > 0) ;
+	bind_reap();
+}
+
+static void bind_poll_fn(struct timer *t)
+{
+	bind_reap();
+	if (bd.running) timer_arm(t, 10, bind_poll_fn);
+}
+
+/* hook child exits into the loop; under --script the poll timer does it */
+static int bind_setup(void)
+{
+	if (!nbinds || ts_source == TS_VIRTUAL) return 0;
+	if (pipe(bd.pipe) < 0) return -1;
+	for (int i = 0; i < 2; ++i) {
+		fcntl(bd.pipe[i], F_SETFL, fcntl(bd.pipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(bd.pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	bd.w.fd = bd.pipe[0]; bd.w.fn = bind_pipe_fn;
+	if (loop_add(&bd.w, EPOLLIN) < 0) return -1;
+	struct sigaction sa; memset(&sa,0,sizeof(sa));
+	sa.sa_handler = sigchld_handler; sigemptyset(&sa.sa_mask); sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	return sigaction(SIGCHLD, &sa, NULL);
+}
+
+extern char **environ;
+
+static void bind_start(int b, const event_t *e, int clicks)
+{
+	int slot = -1;
+	for (int i = 0; i < bind_jobs && slot < 0; ++i) if (!bd.job[i]) slot = i;
+	if (slot < 0) return;
+	static const char *const trig[4] = { "click", "scroll", "drag", "dwell" };
+	char vars[7][32], *envp[512];
+	snprintf(vars[0], sizeof(vars[0]), "MT_X=%d", e->x);
+	snprintf(vars[1], sizeof(vars[1]), "MT_Y=%d", e->y);
+	snprintf(vars[2], sizeof(vars[2]), "MT_BUTTON=%d", e->button);
+	snprintf(vars[3], sizeof(vars[3]), "MT_CLICKS=%d", clicks);
+	snprintf(vars[4], sizeof(vars[4]), "MT_EVENT=%s", trig[binds[b].trig]);
+	snprintf(vars[5], sizeof(vars[5]), "MT_SRC=%d", e->src);
+	snprintf(vars[6], sizeof(vars[6]), "MT_BIND=%d", b + 1);
+	size_t n = 0;
+	for (; n < 7; ++n) envp[n] = vars[n];
+	for (char **p = environ; *p && n + 1 < sizeof(envp) / sizeof(*envp); ++p)
+		if (strncmp(*p, "MT_", 3)) envp[n++] = *p;
+	envp[n] = NULL;
+	/* stdin from /dev/null, the terminals stay ours; own process group so terminal
+	   signals meant for the tool do not reach the commands */
+	posix_spawn_file_actions_t fa; posix_spawnattr_t at;
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	for (int i = 0; i < ntty; ++i) if (ttys[i].fd > STDERR_FILENO) posix_spawn_file_actions_addclose(&fa, ttys[i].fd);
+	posix_spawnattr_init(&at);
+	posix_spawnattr_setflags(&at, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&at, 0);
+	char *argv[] = { "sh", "-c", binds[b].cmd, NULL };
+	pid_t pid;
+	int rc = posix_spawn(&pid, "/bin/sh", &fa, &at, argv, envp);
+	posix_spawn_file_actions_destroy(&fa); posix_spawnattr_destroy(&at);
+	if (rc) { stats.bind_failed++; print_warn("--bind %d: cannot run command: %s", b + 1, strerror(rc)); return; }
+	uint64_t now = ts_now_ns();
+	double lat = now > e->t ? (double)(now - e->t) * 1e-9 : 0.0;
+	int k = 0; while (k < BIND_BUCKETS && lat > bind_bounds[k]) ++k;
+	stats.bind_hist[k]++; stats.bind_runs++; stats.bind_lat_sum += lat;
+	if (lat > stats.bind_lat_max) stats.bind_lat_max = lat;
+	bd.job[slot] = pid; bd.running++;
+	if (ts_source == TS_VIRTUAL && !bd.poll.armed) timer_arm(&bd.poll, 10, bind_poll_fn);
+}
+
+static void bind_dispatch(int b, const event_t *e, int clicks)
+{
+	if (bd.running < bind_jobs && !bd.qn) { bind_start(b, e, clicks); return; }
+	if (bd.qn == BIND_QUEUE) { stats.bind_dropped++; return; }
+	int q = (bd.qh + bd.qn++) % BIND_QUEUE;
+	bd.queue[q].b = b; bd.queue[q].ev = *e; bd.queue[q].clicks = clicks;
+}
+
+/* match an emitted event against the bindings; a press starts or extends a multiclick
+   run (same button and source, within MULTICLICK_MAX_GAP and MULTICLICK_RADIUS) and a
+   :N binding fires on the Nth press of the run without waiting to see whether more follow */
+static void bind_event(const event_t *e)
+{
+	int trig, dir = 0, clicks = 0, x = e->x, y = e->y, s = e->src & (TTY_MAX - 1), btn = e->button & 15;
+	switch (e->type) {
+	case EVT_PRESS: {
+		const event_t *p = &bd.press;
+		int dx = e->x - p->x, dy = e->y - p->y;
+		if (bd.clicks && p->button == e->button && p->src == e->src && e->t >= p->t &&
+		    (double)(e->t - p->t) * 1e-9 <= MULTICLICK_MAX_GAP &&
+		    dx * dx + dy * dy <= MULTICLICK_RADIUS * MULTICLICK_RADIUS) bd.clicks++;
+		else bd.clicks = 1;
+		bd.press = *e; clicks = bd.clicks;
+		bd.down_x[s][btn] = (short)e->x; bd.down_y[s][btn] = (short)e->y;
+		trig = BT_CLICK;
+		break;
+	}
+	case EVT_RELEASE: {
+		int px = bd.down_x[s][btn], py = bd.down_y[s][btn];
+		bd.down_x[s][btn] = 0;
+		if (!px) return;
+		int dx = e->x - px, dy = e->y - py, ax = dx < 0 ? -dx : dx, ay = dy < 0 ? -dy : dy;
+		if (ax < BIND_DRAG && ay < BIND_DRAG) return;
+		dir = ax >= ay ? (dx < 0 ? BD_LEFT : BD_RIGHT) : (dy < 0 ? BD_UP : BD_DOWN);
+		x = px; y = py; trig = BT_DRAG;
+		break;
+	}
+	case EVT_SCROLL:
+		dir = (e->button & 2) ? (e->delta < 0 ? BD_LEFT : BD_RIGHT) : (e->delta < 0 ? BD_UP : BD_DOWN);
+		trig = BT_SCROLL;
+		break;
+	case EVT_DWELL:
+		if (!e->key) return;
+		trig = BT_DWELL;
+		break;
+	default:
+		return;
+	}
+	for (int i = 0; i < nbinds; ++i) {
+		const struct binding *b = &binds[i];
+		if (b->trig != trig) continue;
+		if (!b->any && (x < b->x0 || x > b->x1 || y < b->y0 || y > b->y1)) continue;
+		if (trig == BT_CLICK && ((b->button >= 0 && b->button != e->button) || (b->count && b->count != clicks))) continue;
+		if ((trig == BT_SCROLL || trig == BT_DRAG) && b->dir != dir) continue;
+		bind_dispatch(i, e, clicks);
+		return;
+	}
+}
+
+/* end of session: queued commands are dropped, running ones are waited for so a
+   one-shot "click, then run" session exits after its command */
+static void bind_finish(void)
+{
+	if (!nbinds) return;
+	timer_cancel(&bd.poll);
+	if (bd.qn) { stats.bind_dropped += (unsigned long long)bd.qn; print_warn("--bind: %d queued commands were not run", bd.qn); bd.qn = 0; }
+	for (int i = 0; i < bind_jobs; ++i) {
+		int st; pid_t r;
+		if (!bd.job[i]) continue;
+		while ((r = waitpid(bd.job[i], &st, 0)) < 0 && errno == EINTR) ;
+		if (r == bd.job[i] && (!WIFEXITED(st) || WEXITSTATUS(st))) stats.bind_nonzero++;
+		bd.job[i] = 0; bd.running--;
+	}
+}
+
+/* draw blue dot on the terminal the event came from */
+static void draw_mark(int src, int x, int y)
+{
+	MT_PROBE2(mark_draw, x, y);
+	char seq[128];
+	int n = snprintf(seq, sizeof(seq),
+		"\x1b""7" "\x1b[%d;%dH" "\x1b[34m" "\u25CF" "\x1b[0m" "\x1b""8", y, x);
+	if (n>0) tty_write(src, seq, (size_t)n);
+	/* flush to terminal fd */
+	tcdrain(tty_out_fd(src));
+}
+
+/* color grad */
+static void color_gradient_idx(size_t i, size_t n, int *r, int *g, int *b)
+{
+	if (n<=1) { *r=255; *g=0; *b=0; return; }
+	double t = (double)i / (double)(n-1);
+	*r = (int)((1.0 - t)*255.0 + 0.5);
+	*g = (int)(t*255.0 + 0.5);
+	*b = 0;
+	if (*r<0) *r=0; if (*r>255) *r=255;
+	if (*g<0) *g=0; if (*g>255) *g=255;
+}
+
+/* one playback dot: cursor move plus a gradient-colored glyph for event i of n */
+static int playback_frame_seq(char *seq, size_t cap, const event_t *e, size_t i, size_t n)
+{
+	int R,G,B; color_gradient_idx(i, n, &R,&G,&B);
+	int row = e->y, col = e->x;
+	if (row<1) row=1; if (col<1) col=1;
+	MT_PROBE4(playback_frame, (long)i, (long)n, col, row);
+	return snprintf(seq, cap, "\x1b[%d;%dH\x1b[38;2;%d;%d;%dm\u25CF\x1b[0m", row, col, R, G, B);
+}
+
+/* playback on alt buffer; every event is drawn on its source terminal */
+static void playback_events_color(event_t *events, size_t n)
+{
+	if (n == 0) return;
+	for (int s = 0; s < ntty; ++s) {
+		tty_write(s, "\x1b[?1049h", 8);
+		tty_write(s, "\x1b[?25l", 6);
+		tty_write(s, "\x1b[2J", 4);
+		tcdrain(tty_out_fd(s));
+	}
+
+	for (size_t i = 0; i < n && !got_sig; ++i) {
+		if (i>0) {
+			double dt = (double)(events[i].t - events[i-1].t) * 1e-9;
+			if (dt > 0) {
+				if (dt > 0.5) dt = 0.5;
+				ts_sleep(dt);
+				if (got_sig) break;
+			}
+		}
+		char seq[256];
+		int len = playback_frame_seq(seq, sizeof(seq), &events[i], i, n);
+		if (len>0) tty_write(events[i].src, seq, (size_t)len);
+		tcdrain(tty_out_fd(events[i].src));
+	}
+	if (!got_sig) ts_sleep(1.0);
+	for (int s = 0; s < ntty; ++s) {
+		tty_write(s, "\x1b[?25h", 6);
+		tty_write(s, "\x1b[?1049l", 8);
+		tcdrain(tty_out_fd(s));
+	}
+}
+
+/* helpers */
+static int parse_positive_int(const char *s, long *out) {
+	if (!s) return 0; errno = 0; char *end; long v = strtol(s,&end,10);
+	if (errno || end==s || *end!='\0' || v<=0) return 0; *out = v; return 1;
+}
+static int parse_positive_double(const char *s, double *out) {
+	if (!s) return 0; errno = 0; char *end; double v = strtod(s,&end);
+	if (errno || end==s || *end!='\0' || v<=0.0) return 0; *out = v; return 1;
+}
+static const char *type_str(evtype_t t)
+{
+	if (t == EVT_PRESS) return "press";
+	if (t==EVT_RELEASE) return "release";
+	if (t == EVT_SCROLL) return "scroll";
+	if (t == EVT_KEY) return "key";
+	if (t == EVT_FOCUS) return "focus";
+	if (t == EVT_PASTE) return "paste";
+	if (t == EVT_DWELL) return "dwell";
+	return "motion";
+}
+
+/* JSON string body with escaping (no quotes); returns bytes written */
+static int fput_json_str(FILE *fp, const char *s, size_t n)
+{
+	int w = 0;
+	for (size_t i = 0; i < n; ++i) {
+		unsigned char c = (unsigned char)s[i];
+		if (c == '"' || c == '\\') { fputc('\\', fp); fputc(c, fp); w += 2; }
+		else if (c == '\n') { fputs("\\n", fp); w += 2; }
+		else if (c == '\r') { fputs("\\r", fp); w += 2; }
+		else if (c == '\t') { fputs("\\t", fp); w += 2; }
+		else if (c < 0x20) w += fprintf(fp, "\\u%04x", c);
+		else { fputc(c, fp); w++; }
+	}
+	return w;
+}
+
+/* one event as a JSON object; sp is the separator after ':'-pairs (",", or ", " when pretty).
+   text (pastes only, JSONL) is the pasted data to embed. Returns bytes written. */
+static int fprint_event_json_text(FILE *fp, const event_t *e, double dt, const char *sp, const char *text, size_t tlen)
+{
+	char kb[8];
+	int w = 0;
+	if (e->type == EVT_KEY) {
+		w += fprintf(fp, "{\"type\":\"key\"%s\"key\":\"", sp);
+		const char *name = key_name(e->key, kb, sizeof(kb));
+		w += fput_json_str(fp, name, strlen(name));
+		w += fprintf(fp, "\"%s\"mods\":%d", sp, e->mods);
+	} else if (e->type == EVT_FOCUS) {
+		w += fprintf(fp, "{\"type\":\"focus\"%s\"focus\":\"%s\"", sp, e->key ? "in" : "out");
+	} else if (e->type == EVT_PASTE) {
+		w += fprintf(fp, "{\"type\":\"paste\"%s\"len\":%d", sp, e->key);
+		if (text) { w += fprintf(fp, "%s\"text\":\"", sp); w += fput_json_str(fp, text, tlen); fputc('"', fp); w++; }
+	} else if (e->type == EVT_DWELL) {
+		w += fprintf(fp, "{\"x\":%d%s\"y\":%d%s\"type\":\"dwell\"%s\"state\":\"%s\"%s\"duration\":%.3f",
+			e->x, sp, e->y, sp, sp, e->key ? "start" : "end", sp, e->delta / 1000.0);
+	} else if (e->type == EVT_SCROLL) {
+		int horiz = (e->button & 2) != 0;
+		const char *dir = horiz ? (e->delta < 0 ? "left" : "right") : (e->delta < 0 ? "up" : "down");
+		w += fprintf(fp, "{\"x\":%d%s\"y\":%d%s\"button\":%d%s\"mods\":%d%s\"type\":\"scroll\"%s\"dir\":\"%s\"%s\"axis\":\"%c\"%s\"delta\":%d",
+			e->x, sp, e->y, sp, e->button, sp, e->mods, sp, sp, dir, sp, horiz ? 'h' : 'v', sp, e->delta);
+		if (scroll_frame > 0.0) w += fprintf(fp, "%s\"velocity\":%.1f", sp, e->vel);
+	} else {
+		w += fprintf(fp, "{\"x\":%d%s\"y\":%d%s\"button\":%d%s\"mods\":%d%s\"type\":\"%s\"",
+			e->x, sp, e->y, sp, e->button, sp, e->mods, sp, type_str(e->type));
+	}
+	if (tty_tagged) w += fprintf(fp, "%s\"src\":%d", sp, e->src);
+	if (want_ts) w += fprintf(fp, "%s\"ts\":%.6f", sp, ts_abs(e->t));
+	w += fprintf(fp, "%s\"dt\":%.6f}", sp, dt);
+	return w;
+}
+
+static int fprint_event_json(FILE *fp, const event_t *e, double dt, const char *sp)
+{
+	return fprint_event_json_text(fp, e, dt, sp, NULL, 0);
+}
+
+/* one event as a CSV line: presses as "X,Y,button,mods", other tokens tagged by type;
+   --tty appends the source id, then -T the absolute timestamp. Returns bytes written. */
+static int fprint_event_csv(FILE *fp, const event_t *e)
+{
+	char kb[8];
+	int w;
+	if (e->type == EVT_KEY) w = fprintf(fp, "key,%s,%d", key_name(e->key, kb, sizeof(kb)), e->mods);
+	else if (e->type == EVT_FOCUS) w = fprintf(fp, "focus,%s", e->key ? "in" : "out");
+	else if (e->type == EVT_PASTE) w = fprintf(fp, "paste,%d", e->key);
+	else if (e->type == EVT_DWELL) w = fprintf(fp, "dwell,%s,%d,%d,%.3f", e->key ? "start" : "end", e->x, e->y, e->delta / 1000.0);
+	else w = fprintf(fp, "%d,%d,%d,%d", e->x, e->y, e->button, e->mods);
+	if (tty_tagged) w += fprintf(fp, ",%d", e->src);
+	if (want_ts) w += fprintf(fp, ",%.6f", ts_abs(e->t));
+	fputc('\n', fp);
+	return w + 1;
+}
+
+/* print JSON history with metadata
+   Note: we count only press events for the "outputs" top-level field.
+   outs holds the events in chunks of HIST_CHUNK (one chunk when n is smaller). */
+#define HIST_AT(c, i) (&(c)[(i) / HIST_CHUNK][(i) % HIST_CHUNK])
+static void print_json_history(out_event_t *const *outs, size_t n, FILE *fp, int pretty, const char *mode, const char *started_at, double duration)
+{
+	size_t press_count = 0;
+	for (size_t i = 0; i < n; ++i) if (HIST_AT(outs, i)->ev.type == EVT_PRESS) ++press_count;
+
+	if (!fp) fp = stdout;
+	if (!pretty) {
+		fprintf(fp, "{\"mode\":\"%s\",\"started_at\":\"%s\",\"duration\":%.6f,\"outputs\":%zu,\"events\":[", mode, started_at, duration, press_count);
+		for (size_t i=0;i<n;++i) {
+			if (i) fputc(',', fp);
+			fprint_event_json(fp, &HIST_AT(outs, i)->ev, HIST_AT(outs, i)->dt, ",");
+		}
+		fprintf(fp, "]}\n");
+	} else {
+		fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"started_at\": \"%s\",\n  \"duration\": %.6f,\n  \"outputs\": %zu,\n  \"events\": [\n", mode, started_at, duration, press_count);
+		for (size_t i=0;i<n;++i) {
+			fputs("    ", fp);
+			fprint_event_json(fp, &HIST_AT(outs, i)->ev, HIST_AT(outs, i)->dt, ", ");
+			fprintf(fp, "%s\n", (i+1<n)?",":"");
+		}
+		fprintf(fp, "  ]\n}\n");
+	}
+	fflush(fp);
+}
+
+/* print JSON from events (for record) */
+static void print_json_from_events(event_t *events, size_t n, FILE *fp, int pretty, const char *mode, const char *started_at, double duration)
+{
+	size_t press_count = 0;
+	for (size_t i=0;i<n;++i) if (events[i].type == EVT_PRESS) ++press_count;
+
+	if (!fp) fp = stdout;
+	if (!pretty) {
+		fprintf(fp, "{\"mode\":\"%s\",\"started_at\":\"%s\",\"duration\":%.6f,\"outputs\":%zu,\"events\":[", mode, started_at, duration, press_count);
+		for (size_t i=0;i<n;++i) {
+			event_t *e = &events[i];
+			double dt = 0.0;
+			if (i>0) dt = (double)(e->t - events[i-1].t) * 1e-9;
+			if (i) fputc(',', fp);
+			fprint_event_json(fp, e, dt, ",");
+		}
+		fprintf(fp, "]}\n");
+	} else {
+		fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"started_at\": \"%s\",\n  \"duration\": %.6f,\n  \"outputs\": %zu,\n  \"events\": [\n", mode, started_at, duration, press_count);
+		for (size_t i=0;i<n;++i) {
+			event_t *e = &events[i];
+			double dt = 0.0;
+			if (i>0) dt = (double)(e->t - events[i-1].t) * 1e-9;
+			fputs("    ", fp);
+			fprint_event_json(fp, e, dt, ", ");
+			fprintf(fp, "%s\n", (i+1<n)?",":"");
+		}
+		fprintf(fp, "  ]\n}\n");
+	}
+	fflush(fp);
+}
+
+/* print single json line (jsonl); pastes carry their text here */
+static void print_json_line(event_t *e, double dt, FILE *fp)
+{
+	if (!fp) fp = stdout;
+	int w;
+	if (e->type == EVT_PASTE) {
+		size_t n = e->key < PASTE_MAX ? (size_t)e->key : PASTE_MAX;
+		w = fprint_event_json_text(fp, e, dt, ",", tins[e->src].paste_buf, n);
+	} else {
+		w = fprint_event_json(fp, e, dt, ",");
+	}
+	fputc('\n', fp);
+	stats.bytes_out += (unsigned long long)w + 1;
+	out_flush(fp);
+}
+
+/* stream one event to fp as CSV (presses and key/focus/paste tokens only) or JSONL */
+static void stream_event(FILE *fp, event_t *e, double dt, int csv)
+{
+	if (!csv) { print_json_line(e, dt, fp); return; }
+	if (e->type != EVT_PRESS && e->type < EVT_KEY) return; /* ignore release/motion for CSV */
+	stats.bytes_out += (unsigned long long)fprint_event_csv(fp, e);
+	out_flush(fp);
+}
+
+/* metrics endpoint (--metrics ADDR): Prometheus text format over HTTP on a unix socket
+   ("unix:PATH") or 127.0.0.1:PORT. The listener and its clients are non-blocking watches
+   on the event loop; a scrape is rendered once into the client's buffer and written as
+   the socket accepts it, so a slow scraper never stalls event handling. A series that does
+   not fit the buffer is left out whole, the rest of the scrape with it, and the scrape is
+   counted in mouse_tool_metrics_truncated_total, which always fits (METRICS_TAIL). */
+#define METRICS_CLIENTS 8
+#define METRICS_BUF 16384
+#define METRICS_TAIL 256
+#define METRICS_IDLE_MS 5000
+#define container_of(p, T, m) ((T *)(void *)((char *)(p) - offsetof(T, m)))
+
+struct metrics_client {
+	struct watch w;           /* first member: the handler casts back from the watch */
+	struct timer idle;
+	char req[512]; size_t req_len;
+	char out[METRICS_BUF + 256]; size_t out_len, out_off;
+	int busy;
+};
+static struct watch metrics_listener = { .fd = -1, .fn = NULL };
+static struct metrics_client metrics_clients[METRICS_CLIENTS];
+static char metrics_unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static size_t metrics_render(char *buf, size_t cap)
+{
+	static unsigned long long truncated;
+	size_t n = 0, queued = 0, room = cap - METRICS_TAIL;
+	int cut = 0;
+	for (int i = 0; i < ntty; ++i) queued += tins[i].w - tins[i].r;
+#define MPUT(...) do { if (!cut) { int k_ = snprintf(buf + n, room - n, __VA_ARGS__); if (k_ >= 0 && (size_t)k_ < room - n) n += (size_t)k_; else cut = 1; } } while (0)
+	MPUT("# HELP mouse_tool_events_total Input events by type.\n# TYPE mouse_tool_events_total counter\n");
+	for (int t = EVT_PRESS; t <= EVT_DWELL; ++t)
+		MPUT("mouse_tool_events_total{type=\"%s\"} %llu\n", type_str((evtype_t)t), stats.by_type[t]);
+	MPUT("# HELP mouse_tool_presses_total Presses by decoded button.\n# TYPE mouse_tool_presses_total counter\n");
+	for (int b = 0; b < 16; ++b)
+		if (stats.by_button[b]) MPUT("mouse_tool_presses_total{button=\"%d\"} %llu\n", b, stats.by_button[b]);
+	if (debounce_ns) {
+		MPUT("# HELP mouse_tool_debounce_total Mouse reports fixed by --debounce, by rule.\n# TYPE mouse_tool_debounce_total counter\n");
+		MPUT("mouse_tool_debounce_total{rule=\"duplicate\"} %llu\nmouse_tool_debounce_total{rule=\"chatter\"} %llu\n", stats.deb_dup, stats.deb_chatter);
+		MPUT("mouse_tool_debounce_total{rule=\"repaired\"} %llu\nmouse_tool_debounce_total{rule=\"orphan\"} %llu\n", stats.deb_repaired, stats.deb_orphan);
+	}
+	MPUT("# HELP mouse_tool_filtered_events_total Events rejected by --filter.\n# TYPE mouse_tool_filtered_events_total counter\nmouse_tool_filtered_events_total %llu\n", stats.filtered);
+	MPUT("# HELP mouse_tool_parse_errors_total Malformed or oversized input sequences.\n# TYPE mouse_tool_parse_errors_total counter\nmouse_tool_parse_errors_total %llu\n", stats.parse_errors);
+	MPUT("# HELP mouse_tool_input_bytes_total Bytes read from the terminal.\n# TYPE mouse_tool_input_bytes_total counter\nmouse_tool_input_bytes_total %llu\n", stats.bytes_in);
+	MPUT("# HELP mouse_tool_output_bytes_total Bytes of streamed output.\n# TYPE mouse_tool_output_bytes_total counter\nmouse_tool_output_bytes_total %llu\n", stats.bytes_out);
+	MPUT("# HELP mouse_tool_flushes_total Output flushes.\n# TYPE mouse_tool_flushes_total counter\nmouse_tool_flushes_total %llu\n", stats.flushes);
+	MPUT("# HELP mouse_tool_dropped_events_total Events dropped because a buffer was full.\n# TYPE mouse_tool_dropped_events_total counter\nmouse_tool_dropped_events_total %llu\n", stats.dropped);
+	MPUT("# HELP mouse_tool_input_queue_bytes Terminal bytes buffered but not yet tokenized.\n# TYPE mouse_tool_input_queue_bytes gauge\nmouse_tool_input_queue_bytes %zu\n", queued);
+	MPUT("# HELP mouse_tool_history_events Events held for the final JSON/record dump.\n# TYPE mouse_tool_history_events gauge\nmouse_tool_history_events %zu\n", stats.history);
+	MPUT("# HELP mouse_tool_event_interval_seconds Time between consecutive input events.\n# TYPE mouse_tool_event_interval_seconds histogram\n");
+	unsigned long long cum = 0;
+	for (int b = 0; b < DT_BUCKETS; ++b) {
+		cum += stats.dt_hist[b];
+		MPUT("mouse_tool_event_interval_seconds_bucket{le=\"%g\"} %llu\n", dt_bounds[b], cum);
+	}
+	MPUT("mouse_tool_event_interval_seconds_bucket{le=\"+Inf\"} %llu\n", stats.dt_count);
+	MPUT("mouse_tool_event_interval_seconds_sum %.6f\nmouse_tool_event_interval_seconds_count %llu\n", stats.dt_sum, stats.dt_count);
+	if (nbinds) {
+		MPUT("# HELP mouse_tool_bind_commands_total --bind commands by outcome.\n# TYPE mouse_tool_bind_commands_total counter\n");
+		MPUT("mouse_tool_bind_commands_total{outcome=\"run\"} %llu\nmouse_tool_bind_commands_total{outcome=\"failed\"} %llu\n", stats.bind_runs, stats.bind_failed);
+		MPUT("mouse_tool_bind_commands_total{outcome=\"dropped\"} %llu\nmouse_tool_bind_commands_total{outcome=\"nonzero\"} %llu\n", stats.bind_dropped, stats.bind_nonzero);
+		MPUT("# HELP mouse_tool_bind_latency_seconds Time from event to command spawn.\n# TYPE mouse_tool_bind_latency_seconds histogram\n");
+		unsigned long long bcum = 0;
+		for (int b = 0; b < BIND_BUCKETS; ++b) {
+			bcum += stats.bind_hist[b];
+			MPUT("mouse_tool_bind_latency_seconds_bucket{le=\"%g\"} %llu\n", bind_bounds[b], bcum);
+		}
+		MPUT("mouse_tool_bind_latency_seconds_bucket{le=\"+Inf\"} %llu\n", stats.bind_runs);
+		MPUT("mouse_tool_bind_latency_seconds_sum %.6f\nmouse_tool_bind_latency_seconds_count %llu\n", stats.bind_lat_sum, stats.bind_runs);
+	}
+	if (dwell_ms) MPUT("# HELP mouse_tool_dwell_seconds_total Time the pointer rested in finished dwells.\n# TYPE mouse_tool_dwell_seconds_total counter\nmouse_tool_dwell_seconds_total %.3f\n", (double)dw.total_ms / 1000.0);
+	MPUT("# HELP mouse_tool_uptime_seconds Seconds since the session started.\n# TYPE mouse_tool_uptime_seconds gauge\nmouse_tool_uptime_seconds %.3f\n",
+		stats.start ? (double)(ts_now_ns() - stats.start) * 1e-9 : 0.0);
+#undef MPUT
+	if (cut) truncated++;
+	int k = snprintf(buf + n, cap - n, "# HELP mouse_tool_metrics_truncated_total Scrapes cut short by the metrics buffer.\n"
+		"# TYPE mouse_tool_metrics_truncated_total counter\nmouse_tool_metrics_truncated_total %llu\n", truncated);
+	if (k > 0 && (size_t)k < cap - n) n += (size_t)k;
+	return n;
+}
+
+static void metrics_client_close(struct metrics_client *c)
+{
+	timer_cancel(&c->idle);
+	loop_del(&c->w);
+	close(c->w.fd);
+	c->w.fd = -1; c->busy = 0;
+}
+
+static void metrics_idle_fn(struct timer *t) { metrics_client_close(container_of(t, struct metrics_client, idle)); }
+
+static void metrics_client_fn(struct watch *w, uint32_t events)
+{
+	struct metrics_client *c = (struct metrics_client *)w;
+	if (!c->out_len) {
+		ssize_t r = recv(w->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+		if (r <= 0) { metrics_client_close(c); return; }
+		c->req_len += (size_t)r; c->req[c->req_len] = '\0';
+		if (!strstr(c->req, "\r\n\r\n") && !strstr(c->req, "\n\n") && c->req_len + 1 < sizeof(c->req)) return;
+		static char body[METRICS_BUF];
+		size_t blen = metrics_render(body, sizeof(body));
+		int h = snprintf(c->out, sizeof(c->out),
+			"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", blen);
+		memcpy(c->out + h, body, blen);
+		c->out_len = (size_t)h + blen; c->out_off = 0;
+	} else if (events & (EPOLLERR | EPOLLHUP)) { metrics_client_close(c); return; }
+	while (c->out_off < c->out_len) {
+		ssize_t k = send(w->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+		if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { loop_mod(w, EPOLLOUT); return; }
+		if (k <= 0) break;
+		c->out_off += (size_t)k;
+	}
+	metrics_client_close(c);
+}
+
+static void metrics_accept_fn(struct watch *w, uint32_t events)
+{
+	(void)events;
+	for (;;) {
+		int fd = accept(w->fd, NULL, NULL);
+		if (fd < 0) return;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		struct metrics_client *c = NULL;
+		for (int i = 0; i < METRICS_CLIENTS; ++i) if (!metrics_clients[i].busy) { c = &metrics_clients[i]; break; }
+		if (!c) { close(fd); continue; } /* all slots busy: shed the scrape */
+		c->busy = 1; c->w.fd = fd; c->w.fn = metrics_client_fn;
+		c->req_len = 0; c->out_len = c->out_off = 0;
+		if (loop_add(&c->w, EPOLLIN) < 0) { close(fd); c->busy = 0; continue; }
+		timer_arm(&c->idle, METRICS_IDLE_MS, metrics_idle_fn);
+	}
+}
+
+static void metrics_close(void)
+{
+	for (int i = 0; i < METRICS_CLIENTS; ++i) if (metrics_clients[i].busy) metrics_client_close(&metrics_clients[i]);
+	if (metrics_listener.fd >= 0) { loop_del(&metrics_listener); close(metrics_listener.fd); metrics_listener.fd = -1; }
+	if (metrics_unix_path[0]) { unlink(metrics_unix_path); metrics_unix_path[0] = '\0'; }
+}
+
+/* bind a unix stream socket at path, replacing a stale socket (never another file).
+   returns the fd, -1 with errno set, or -2 when the path is empty or too long */
+static int unix_bind(const char *path)
+{
+	struct sockaddr_un sun; memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (!*path || strlen(path) >= sizeof(sun.sun_path)) return -2;
+	strcpy(sun.sun_path, path);
+	struct stat st;
+	if (stat(path, &st) == 0) { if (!S_ISSOCK(st.st_mode)) { errno = EEXIST; return -1; } unlink(path); }
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) return -1;
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) { int e = errno; close(fd); errno = e; return -1; }
+	return fd;
+}
+
+/* open the listener: "unix:PATH", "PORT" or "127.0.0.1:PORT" (local only).
+   returns 0 ok, 2 invalid address, 1 socket error (errno set) */
+static int metrics_open(const char *addr)
+{
+	int fd;
+	if (!strncmp(addr, "unix:", 5)) {
+		fd = unix_bind(addr + 5);
+		if (fd == -2) return 2;
+		if (fd < 0) return 1;
+		strcpy(metrics_unix_path, addr + 5);
+	} else {
+		const char *port = addr;
+		if (!strncmp(addr, "127.0.0.1:", 10)) port = addr + 10;
+		else if (!strncmp(addr, "localhost:", 10)) port = addr + 10;
+		long p;
+		if (!parse_positive_int(port, &p) || p > 65535) return 2;
+		struct sockaddr_in sin; memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET; sin.sin_port = htons((unsigned short)p);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) return 1;
+		int one = 1; setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) { int e = errno; close(fd); errno = e; return 1; }
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (listen(fd, METRICS_CLIENTS) < 0) { int e = errno; close(fd); errno = e; return 1; }
+	metrics_listener.fd = fd; metrics_listener.fn = metrics_accept_fn;
+	if (loop_add(&metrics_listener, EPOLLIN) < 0) { int e = errno; close(fd); metrics_listener.fd = -1; errno = e; return 1; }
+	atexit(metrics_close);
+	return 0;
+}
+
+/* session history: JSON modes keep every emitted event (outs), record mode keeps the
+   raw events for playback; the control channel snapshots it mid-session */
+static struct {
+	out_event_t *outs[HIST_CHUNKS]; size_t outs_count, outs_chunks;
+	event_t *events; size_t ev_count, max_events;
+	char started_at[64];
+} hist;
+
+/* JSON history lives in chunks of HIST_CHUNK events: the first is reserved up front
+   (calloc'd pages stay untouched until used) and the next one only when it is full, so
+   streaming allocates once per HIST_CHUNK events and nothing is ever copied. Events
+   that find no chunk (out of memory, or HIST_CHUNKS full) are counted as dropped. */
+static int hist_grow(void)
+{
+	if (hist.outs_chunks == HIST_CHUNKS) return -1;
+	if (!hist.outs[hist.outs_chunks] && !(hist.outs[hist.outs_chunks] = calloc(HIST_CHUNK, sizeof(out_event_t)))) return -1;
+	hist.outs_chunks++;
+	return 0;
+}
+
+static int hist_reserve(void) { return hist.outs_chunks ? 0 : hist_grow(); }
+
+static void hist_push(const event_t *ev, double dt)
+{
+	if (hist.outs_count == hist.outs_chunks * HIST_CHUNK && hist_grow() < 0) { stats.dropped++; return; }
+	out_event_t *o = HIST_AT(hist.outs, hist.outs_count);
+	o->ev = *ev; o->dt = dt;
+	stats.history = ++hist.outs_count;
+}
+
+static void hist_free(void)
+{
+	for (size_t i = 0; i < hist.outs_chunks; ++i) { free(hist.outs[i]); hist.outs[i] = NULL; }
+	hist.outs_chunks = hist.outs_count = 0;
+}
+
+static int hist_available(void) { return hist.events || hist.outs_chunks || out_mode == OUT_JSON || out_mode == OUT_PRETTY; }
+
+/* the history as one JSON document */
+static void hist_dump_json(FILE *fp, int pretty)
+{
+	double duration = 0.0;
+	if (hist.events) {
+		if (hist.ev_count > 1) duration = (double)(hist.events[hist.ev_count-1].t - hist.events[0].t) * 1e-9;
+		print_json_from_events(hist.events, hist.ev_count, fp, pretty, "record", hist.started_at, duration);
+		return;
+	}
+	for (size_t i = 0; i < hist.outs_count; ++i) duration += HIST_AT(hist.outs, i)->dt;
+	print_json_history(hist.outs, hist.outs_count, fp, pretty, "stream", hist.started_at, duration);
+}
+
+/* control channel (--control PATH): a unix socket taking one command per line and
+   answering one "ok ..." or "err ..." line. Commands run as loop handlers between two
+   events, so they change session state without any locking on the event path. */
+#define CTL_CLIENTS 4
+struct ctl_client {
+	struct watch w;           /* first member: the handler casts back from the watch */
+	char line[512]; size_t len;
+	int busy;
+};
+static struct watch ctl_listener = { .fd = -1, .fn = NULL };
+static struct ctl_client ctl_clients[CTL_CLIENTS];
+static char ctl_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int paused = 0;   /* events are still read and counted, but not output or stored */
+
+static void ctl_reply(struct ctl_client *c, const char *fmt, ...)
+{
+	char buf[512];
+	va_list ap; va_start(ap, fmt);
+	int n = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+	va_end(ap);
+	if (n < 0) return;
+	if (n > (int)sizeof(buf) - 2) n = (int)sizeof(buf) - 2;
+	buf[n++] = '\n';
+	/* replies are short; a client that stops reading only loses its own replies */
+	send(c->w.fd, buf, (size_t)n, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/* split "word rest": terminates the word, returns rest without leading blanks */
+static char *ctl_split(char *s)
+{
+	char *r = s + strcspn(s, " \t");
+	if (*r) { *r++ = '\0'; r += strspn(r, " \t"); }
+	return r;
+}
+
+static void ctl_snapshot(struct ctl_client *c, const char *path)
+{
+	if (!*path) { ctl_reply(c, "err snapshot needs a path"); return; }
+	if (!hist_available()) { ctl_reply(c, "err no history in this mode (use -j, -p or -r)"); return; }
+	/* write aside and rename, so readers never see a partial document */
+	char tmp[4096];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) { ctl_reply(c, "err path too long"); return; }
+	FILE *fp = fopen(tmp, "w");
+	if (!fp) { ctl_reply(c, "err %s: %s", tmp, strerror(errno)); return; }
+	hist_dump_json(fp, out_mode == OUT_PRETTY);
+	int bad = ferror(fp);
+	if (fclose(fp) != 0 || bad) { ctl_reply(c, "err writing %s failed", tmp); unlink(tmp); return; }
+	if (rename(tmp, path) < 0) { ctl_reply(c, "err %s: %s", path, strerror(errno)); unlink(tmp); return; }
+	ctl_reply(c, "ok %zu events", hist.events ? hist.ev_count : hist.outs_count);
+}
+
+static void ctl_sink(struct ctl_client *c, char *arg)
+{
+	char *path = ctl_split(arg);
+	if (hist.events) { ctl_reply(c, "err record mode has no output stream"); return; }
+	if (!*path) { ctl_reply(c, "err usage: sink add|del PATH"); return; }
+	int i = 0;
+	while (i < nsinks && strcmp(sinks[i].path, path)) ++i;
+	if (!strcmp(arg, "add")) {
+		if (i < nsinks) { ctl_reply(c, "err %s is already a sink", path); return; }
+		if (nsinks == SINK_MAX) { ctl_reply(c, "err at most %d sinks", SINK_MAX); return; }
+		if (strlen(path) >= sizeof(sinks[0].path)) { ctl_reply(c, "err path too long"); return; }
+		FILE *fp = fopen(path, "ae");
+		if (!fp) { ctl_reply(c, "err %s: %s", path, strerror(errno)); return; }
+		sinks[nsinks].fp = fp; strcpy(sinks[nsinks].path, path); nsinks++;
+		ctl_reply(c, "ok %d sinks", nsinks);
+	} else if (!strcmp(arg, "del")) {
+		if (i == nsinks) { ctl_reply(c, "err %s is not a sink", path); return; }
+		fclose(sinks[i].fp);
+		sinks[i] = sinks[--nsinks];
+		ctl_reply(c, "ok %d sinks", nsinks);
+	} else ctl_reply(c, "err usage: sink add|del PATH");
+}
+
+static void ctl_command(struct ctl_client *c, char *cmd)
+{
+	char *arg = ctl_split(cmd);
+	if (!*cmd) return;
+	if (!strcmp(cmd, "pause")) { paused = 1; ctl_reply(c, "ok paused"); }
+	else if (!strcmp(cmd, "resume")) { paused = 0; ctl_reply(c, "ok resumed"); }
+	else if (!strcmp(cmd, "stats")) {
+		char line[512]; stats_format(line, sizeof(line));
+		ctl_reply(c, "ok %s history=%zu sinks=%d%s", line, stats.history, nsinks, paused ? " paused" : "");
+	}
+	else if (!strcmp(cmd, "snapshot")) ctl_snapshot(c, arg);
+	else if (!strcmp(cmd, "dwell")) {
+		if (!dwell_ms) { ctl_reply(c, "err dwell detection is off (--dwell R,MS)"); return; }
+		char buf[400]; size_t n = 0; buf[0] = '\0';
+		const struct dw_cell *top[5] = { 0 };   /* five longest blocks, kept sorted */
+		for (size_t i = 0; i < dw.cap; ++i) {
+			const struct dw_cell *e = &dw.cells[i];
+			if (!e->n) continue;
+			int k = 5;
+			while (k > 0 && (!top[k - 1] || top[k - 1]->ms < e->ms)) { if (k < 5) top[k] = top[k - 1]; --k; }
+			if (k < 5) top[k] = e;
+		}
+		for (int k = 0; k < 5 && top[k]; ++k)
+			n += (size_t)snprintf(buf + n, sizeof(buf) - n, " %d,%d=%.3f", top[k]->cx * dwell_cw + 1, top[k]->cy * dwell_ch + 1, (double)top[k]->ms / 1000.0);
+		ctl_reply(c, "ok dwells=%llu seconds=%.3f cells=%zu dropped=%llu%s%s", dw.count, (double)dw.total_ms / 1000.0, dw.used, dw.dropped, dw.on ? " resting" : "", buf);
+	}
+	else if (!strcmp(cmd, "format")) {
+		static const char *names[] = { "csv", "json", "pretty", "jsonl" }; /* indexed by OUT_* */
+		int m = 0;
+		while (m < 4 && strcmp(arg, names[m])) ++m;
+		if (m == 4) { ctl_reply(c, "err format must be csv, jsonl, json or pretty"); return; }
+		if ((m == OUT_JSON || m == OUT_PRETTY) && hist_reserve() < 0) { ctl_reply(c, "err cannot allocate history"); return; }
+		FILE *fp = out_fp ? out_fp : stdout;
+		if ((out_mode == OUT_JSON || out_mode == OUT_PRETTY) && m != OUT_JSON && m != OUT_PRETTY && !hist.events) {
+			/* leaving a history format: write what was collected so far, then stream */
+			hist_dump_json(fp, out_mode == OUT_PRETTY);
+			hist.outs_count = 0; stats.history = 0;
+		}
+		fflush(fp);
+		out_mode = m;
+		ctl_reply(c, "ok format %s", names[m]);
+	}
+	else if (!strcmp(cmd, "flush")) {
+		long v;
+		if (!strcmp(arg, "event")) { flush_interval_ms = 0; timer_cancel(&flush_timer); }
+		else if (parse_positive_int(arg, &v)) { flush_interval_ms = (uint64_t)v; timer_arm(&flush_timer, flush_interval_ms, flush_fn); }
+		else { ctl_reply(c, "err usage: flush event|MS"); return; }
+		fflush(out_fp ? out_fp : stdout);
+		ctl_reply(c, "ok flush %s", arg);
+	}
+	else if (!strcmp(cmd, "sink")) ctl_sink(c, arg);
+	else if (!strcmp(cmd, "sinks")) {
+		char buf[400]; size_t n = 0; buf[0] = '\0';
+		for (int i = 0; i < nsinks && n < sizeof(buf); ++i) n += (size_t)snprintf(buf + n, sizeof(buf) - n, " %s", sinks[i].path);
+		ctl_reply(c, "ok %d%s", nsinks, buf);
+	}
+	else if (!strcmp(cmd, "stop")) { loop_stop = 1; ctl_reply(c, "ok stopping"); }
+	else if (!strcmp(cmd, "help")) ctl_reply(c, "ok pause | resume | stats | dwell | snapshot PATH | format csv|jsonl|json|pretty | flush event|MS | sink add|del PATH | sinks | stop");
+	else ctl_reply(c, "err unknown command '%s'", cmd);
+}
+
+static void ctl_client_close(struct ctl_client *c)
+{
+	loop_del(&c->w);
+	close(c->w.fd);
+	c->w.fd = -1; c->busy = 0;
+}
+
+static void ctl_client_fn(struct watch *w, uint32_t events)
+{
+	(void)events;
+	struct ctl_client *c = (struct ctl_client *)w;
+	ssize_t r = recv(w->fd, c->line + c->len, sizeof(c->line) - 1 - c->len, 0);
+	if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+	if (r <= 0) { ctl_client_close(c); return; }
+	c->len += (size_t)r; c->line[c->len] = '\0';
+	char *p = c->line, *nl;
+	while ((nl = memchr(p, '\n', c->len - (size_t)(p - c->line)))) {
+		*nl = '\0';
+		if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+		ctl_command(c, p);
+		p = nl + 1;
+	}
+	c->len -= (size_t)(p - c->line);
+	memmove(c->line, p, c->len);
+	if (c->len == sizeof(c->line) - 1) { ctl_reply(c, "err line too long"); ctl_client_close(c); }
+}
+
+static void ctl_accept_fn(struct watch *w, uint32_t events)
+{
+	(void)events;
+	for (;;) {
+		int fd = accept(w->fd, NULL, NULL);
+		if (fd < 0) return;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		struct ctl_client *c = NULL;
+		for (int i = 0; i < CTL_CLIENTS; ++i) if (!ctl_clients[i].busy) { c = &ctl_clients[i]; break; }
+		if (!c) { send(fd, "err busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT); close(fd); continue; }
+		c->busy = 1; c->w.fd = fd; c->w.fn = ctl_client_fn; c->len = 0;
+		if (loop_add(&c->w, EPOLLIN) < 0) { close(fd); c->busy = 0; }
+	}
+}
+
+static void ctl_close(void)
+{
+	for (int i = 0; i < CTL_CLIENTS; ++i) if (ctl_clients[i].busy) ctl_client_close(&ctl_clients[i]);
+	if (ctl_listener.fd >= 0) { loop_del(&ctl_listener); close(ctl_listener.fd); ctl_listener.fd = -1; }
+	if (ctl_path[0]) { unlink(ctl_path); ctl_path[0] = '\0'; }
+}
+
+/* open the control socket; returns 0 ok, 2 invalid path, 1 socket error (errno set) */
+static int ctl_open(const char *path)
+{
+	int fd = unix_bind(path);
+	if (fd == -2) return 2;
+	if (fd < 0) return 1;
+	strcpy(ctl_path, path);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (listen(fd, CTL_CLIENTS) < 0 || (ctl_listener.fd = fd, ctl_listener.fn = ctl_accept_fn, loop_add(&ctl_listener, EPOLLIN) < 0)) {
+		int e = errno; close(fd); ctl_listener.fd = -1; unlink(path); ctl_path[0] = '\0'; errno = e; return 1;
+	}
+	atexit(ctl_close);
+	return 0;
+}
+
+/* wait for first press (blocking). returns:
+   1 -> got press (ev filled)
+   0 -> failure/timeout/enter/signal
+*/
+static int wait_for_first_press(event_t *ev)
+{
+	while (!got_sig) {
+		int r = read_event(ev, -1.0, 0);
+		if (r == 1 && ev->type == EVT_PRESS) return 1;
+		if (r == 2) return 0; /* Enter pressed -> treat as failure/abort */
+		if (r == -1) return 0;
+	}
+	return 0;
+}
+
+/* wait for N-1 more presses near (firstx,firsty). returns 0 success, 1 mismatch/timeout */
+static int wait_multiclick_followups(int firstx, int firsty, int total_N)
+{
+	if (total_N <= 1) return 0;
+	int count = 1;
+	event_t ev;
+	while (count < total_N && !got_sig) {
+		int r = read_event(&ev, MULTICLICK_MAX_GAP, 0);
+		if (r == 0) return 1; /* timeout */
+		if (r == -1) return 1;
+		if (r == 2) return 1; /* Enter -> treat as failure for multiclick */
+		if (ev.type != EVT_PRESS) continue;
+		int dx = firstx - ev.x, dy = firsty - ev.y;
+		if (dx*dx + dy*dy <= MULTICLICK_RADIUS * MULTICLICK_RADIUS) {
+			count++;
+			continue;
+		} else return 1;
+	}
+	return (count == total_N) ? 0 : 1;
+}
+
+/* multiclick gap deadline (armed at every accepted press) */
+static struct timer click_gap;
+static void click_gap_fn(struct timer *t) { (void)t; loop_wake = 1; }
+
+/* multiclick followup test: 1 counts toward the click, 0 is ignored, -1 breaks it */
+static int click_followup(const event_t *first, const event_t *ev)
+{
+	if (ev->type != EVT_PRESS) return 0;
+	if (ev->button != first->button || ev->src != first->src) return -1; /* other button or terminal */
+	int dx = first->x - ev->x, dy = first->y - ev->y;
+	return dx*dx + dy*dy <= MULTICLICK_RADIUS * MULTICLICK_RADIUS ? 1 : -1; /* too far -> failure */
+}
+
+/* handle -c: print LAST click (not first) in selected format; if timeout/mismatch -> print none */
+static int handle_click_mode(int N, int out_mode_local, FILE *outfp, int do_mark_local, const char *started_at)
+{
+	event_t first;
+	if (!wait_for_first_press(&first)) {
+		/* no first press (enter/signal/EOF) */
+		return 1;
+	}
+
+	/* accumulate N clicks that must be near the first; update 'last' to the most recent valid press */
+	event_t last = first;
+	if (N > 1) {
+		int count = 1;
+		event_t ev;
+		timer_arm(&click_gap, (uint64_t)(MULTICLICK_MAX_GAP * 1000.0), click_gap_fn);
+		while (count < N && !got_sig) {
+			int r = read_event(&ev, -1.0, 0);
+			if (r == 0) { /* gap expired -> failure */
+				if (click_gap.armed) continue; /* some other timer woke us */
+				return 1;
+			}
+			if (r == -1) return 1;
+			if (r == 2) return 1; /* Enter pressed -> failure */
+			int f = click_followup(&first, &ev);
+			if (f == 0) continue;
+			if (f < 0) return 1;
+			count++;
+			last = ev;
+			timer_arm(&click_gap, (uint64_t)(MULTICLICK_MAX_GAP * 1000.0), click_gap_fn);
+		}
+		timer_cancel(&click_gap);
+		if (count != N) return 1;
+	}
+
+	/* Success: emit the last click (not the first) */
+	if (do_mark_local) draw_mark(last.src, last.x, last.y);
+	MT_PROBE5(event_emit, last.x, last.y, (int)last.type, last.button, last.t);
+
+	if (out_mode_local == OUT_JSONL) {
+		print_json_line(&last, 0.0, outfp?outfp:stdout);
+	} else if (out_mode_local == OUT_JSON || out_mode_local == OUT_PRETTY) {
+		out_event_t one = { .ev = last, .dt = 0.0 }, *onep = &one;
+		print_json_history(&onep, 1, outfp?outfp:stdout, out_mode_local==OUT_PRETTY, "click", started_at, 0.0);
+	} else {
+		if (!outfp) outfp = stdout;
+		fprint_event_csv(outfp, &last);
+		fflush(outfp);
+	}
+
+	return 0;
+}
+
+/* event filter (--filter EXPR): parsed once into a small stack-machine program that
+   runs on every event before marking, counting, formatting or any I/O.
+     EXPR := OR;  OR := AND {"||" AND};  AND := NOT {"&&" NOT};  NOT := "!" NOT | CMP
+     CMP  := SUM [("=="|"!="|"<"|"<="|">"|">=") SUM];  SUM := ATOM {"&" ATOM}
+     ATOM := FIELD | NUMBER | NAME | "KEY" | 'KEY' | "(" OR ")"
+   FIELD: type x y button mods src key delta. NAME: an event type (press, motion, ...;
+   "key" is the field, except in type == key), a button (left, middle, right) or a modifier (shift, alt, ctrl); a quoted key name
+   becomes its key code. "field OP constant", the common case, compiles to one fused
+   instruction, and && / || jump past the rest of the program as soon as it is decided. */
+enum { FL_FIELD, FL_CONST, FL_FCMP, FL_CMP, FL_AND, FL_NOT, FL_JF, FL_JT, FL_TRUTH };
+enum { FL_EQ, FL_NE, FL_LT, FL_LE, FL_GT, FL_GE };
+#define FL_MAX 256
+#define FL_DEPTH 64   /* nested "(" and "!" */
+struct fl_op { unsigned char op, field, cmp; int v; };   /* v: constant, or jump target */
+static struct fl_op fl_prog[FL_MAX];
+static int fl_n = 0;
+
+static const char *const fl_fields[] = { "type", "x", "y", "button", "mods", "src", "key", "delta" };
+static const struct { const char *name; int v; } fl_names[] = {
+	{"press", EVT_PRESS}, {"motion", EVT_MOTION}, {"release", EVT_RELEASE}, {"scroll", EVT_SCROLL},
+	{"focus", EVT_FOCUS}, {"paste", EVT_PASTE}, {"dwell", EVT_DWELL},
+	{"left", 0}, {"middle", 1}, {"right", 2}, {"shift", 1}, {"alt", 2}, {"meta", 2}, {"ctrl", 4},
+};
+
+static int an_key(const char *s, size_t n);
+
+struct fl_parse { const char *s, *p, *err; int depth; };
+
+static void fl_ws(struct fl_parse *ps) { while (*ps->p == ' ' || *ps->p == '\t') ps->p++; }
+
+static int fl_emit(struct fl_parse *ps, int op, int field, int cmp, int v)
+{
+	if (fl_n == FL_MAX) { if (!ps->err) ps->err = "expression too long"; return -1; }
+	fl_prog[fl_n] = (struct fl_op){ (unsigned char)op, (unsigned char)field, (unsigned char)cmp, v };
+	return fl_n++;
+}
+
+static int fl_or(struct fl_parse *ps);
+
+/* one operand; a bare field name is compiled lazily, so "x > 3" can fuse */
+static int fl_atom(struct fl_parse *ps, int *field, int *cnst, int *v)
+{
+	fl_ws(ps);
+	const char *p = ps->p;
+	*field = -1; *cnst = 0;
+	if (*p == '(') {
+		if (++ps->depth > FL_DEPTH) { ps->err = "nested too deeply"; return -1; }
+		ps->p++;
+		if (fl_or(ps) < 0) return -1;   /* value stays on the stack */
+		fl_ws(ps);
+		if (*ps->p != ')') { ps->err = "expected ')'"; return -1; }
+		ps->p++; ps->depth--;
+		return 0;
+	}
+	if ((*p >= '0' && *p <= '9') || (*p == '-' && p[1] >= '0' && p[1] <= '9')) {
+		char *end; errno = 0;
+		long n = strtol(p, &end, 10);
+		if (errno || n > 0x7fffffff || n < -0x7fffffff - 1) { ps->err = "number out of range"; return -1; }
+		ps->p = end; *cnst = 1; *v = (int)n;
+		return 0;
+	}
+	if (*p == '"' || *p == '\'') {
+		const char *q = strchr(p + 1, *p);
+		if (!q || q == p + 1) { ps->err = "unterminated or empty key name"; return -1; }
+		*cnst = 1; *v = an_key(p + 1, (size_t)(q - p - 1));
+		ps->p = q + 1;
+		return 0;
+	}
+	size_t n = 0;
+	while ((p[n] >= 'a' && p[n] <= 'z') || p[n] == '_') n++;
+	if (!n) { ps->err = "expected a field, number or name"; return -1; }
+	ps->p = p + n;
+	for (int f = 0; f < (int)(sizeof(fl_fields) / sizeof(*fl_fields)); ++f)
+		if (strlen(fl_fields[f]) == n && !memcmp(p, fl_fields[f], n)) { *field = f; return 0; }
+	for (size_t i = 0; i < sizeof(fl_names) / sizeof(*fl_names); ++i)
+		if (strlen(fl_names[i].name) == n && !memcmp(p, fl_names[i].name, n)) { *cnst = 1; *v = fl_names[i].v; return 0; }
+	ps->p = p;
+	ps->err = "unknown name";
+	return -1;
+}
+
+/* put an atom's value on the stack */
+static int fl_push(struct fl_parse *ps, int field, int cnst, int v)
+{
+	if (field >= 0) return fl_emit(ps, FL_FIELD, field, 0, 0);
+	if (cnst) return fl_emit(ps, FL_CONST, 0, 0, v);
+	return 0;   /* parenthesized: already there */
+}
+
+static int fl_sum(struct fl_parse *ps, int *field, int *cnst, int *v)
+{
+	if (fl_atom(ps, field, cnst, v) < 0) return -1;
+	for (;;) {
+		fl_ws(ps);
+		if (ps->p[0] != '&' || ps->p[1] == '&') return 0;
+		ps->p++;
+		int f2, c2, v2;
+		if (fl_push(ps, *field, *cnst, *v) < 0) return -1;
+		if (fl_atom(ps, &f2, &c2, &v2) < 0 || fl_push(ps, f2, c2, v2) < 0 || fl_emit(ps, FL_AND, 0, 0, 0) < 0) return -1;
+		*field = -1; *cnst = 0;
+	}
+}
+
+/* the parse functions return -1 on error, 1 when they left a 0/1 result, 0 for a raw value */
+static int fl_cmp(struct fl_parse *ps)
+{
+	int f1, c1, v1, f2, c2, v2, op = -1;
+	if (fl_sum(ps, &f1, &c1, &v1) < 0) return -1;
+	fl_ws(ps);
+	const char *p = ps->p;
+	if (p[0] == '=' && p[1] == '=') op = FL_EQ;
+	else if (p[0] == '!' && p[1] == '=') op = FL_NE;
+	else if (p[0] == '<') op = p[1] == '=' ? FL_LE : FL_LT;
+	else if (p[0] == '>') op = p[1] == '=' ? FL_GE : FL_GT;
+	if (op < 0) return fl_push(ps, f1, c1, v1) < 0 ? -1 : 0;   /* a bare value: true when non-zero */
+	ps->p += (op == FL_LT || op == FL_GT) ? 1 : 2;
+	int lazy = f1 >= 0 || c1;   /* lhs not on the stack yet */
+	if (fl_sum(ps, &f2, &c2, &v2) < 0) return -1;
+	static const unsigned char flip[] = { FL_EQ, FL_NE, FL_GT, FL_GE, FL_LT, FL_LE };
+	if (f1 == 0 && f2 == 6) { f2 = -1; c2 = 1; v2 = EVT_KEY; }   /* type == key */
+	if (f1 == 6 && f2 == 0) { f1 = -1; c1 = 1; v1 = EVT_KEY; }
+	if (f1 >= 0 && c2) return fl_emit(ps, FL_FCMP, f1, op, v2) < 0 ? -1 : 1;
+	if (c1 && f2 >= 0) return fl_emit(ps, FL_FCMP, f2, flip[op], v1) < 0 ? -1 : 1;   /* constant OP field */
+	if (lazy && f2 < 0 && !c2) {   /* rhs was computed first: push lhs after it and compare mirrored */
+		if (fl_push(ps, f1, c1, v1) < 0) return -1;
+		return fl_emit(ps, FL_CMP, 0, flip[op], 0) < 0 ? -1 : 1;
+	}
+	if ((lazy && fl_push(ps, f1, c1, v1) < 0) || fl_push(ps, f2, c2, v2) < 0) return -1;
+	return fl_emit(ps, FL_CMP, 0, op, 0) < 0 ? -1 : 1;
+}
+
+static int fl_not(struct fl_parse *ps)
+{
+	fl_ws(ps);
+	if (ps->p[0] == '!' && ps->p[1] != '=') {
+		if (++ps->depth > FL_DEPTH) { ps->err = "nested too deeply"; return -1; }
+		ps->p++;
+		if (fl_not(ps) < 0) return -1;
+		ps->depth--;
+		return fl_emit(ps, FL_NOT, 0, 0, 0) < 0 ? -1 : 1;
+	}
+	return fl_cmp(ps);
+}
+
+/* "&&" (jf) or "||" (jt) chains of sub; operands are made 0/1 so the chain's value is too */
+static int fl_chain(struct fl_parse *ps, char c, int jump, int (*sub)(struct fl_parse *))
+{
+	int b = sub(ps);
+	if (b < 0) return -1;
+	for (;;) {
+		fl_ws(ps);
+		if (ps->p[0] != c || ps->p[1] != c) return b;
+		ps->p += 2;
+		if (!b && fl_emit(ps, FL_TRUTH, 0, 0, 0) < 0) return -1;
+		int j = fl_emit(ps, jump, 0, 0, 0);
+		if (j < 0 || (b = sub(ps)) < 0 || (!b && fl_emit(ps, FL_TRUTH, 0, 0, 0) < 0)) return -1;
+		fl_prog[j].v = fl_n;
+		b = 1;
+	}
+}
+
+static int fl_and(struct fl_parse *ps) { return fl_chain(ps, '&', FL_JF, fl_not); }
+static int fl_or(struct fl_parse *ps) { return fl_chain(ps, '|', FL_JT, fl_and); }
+
+/* compile src into fl_prog; on error returns -1 with a message and the column */
+static int fl_compile(const char *src, const char **err, int *col)
+{
+	struct fl_parse ps = { src, src, NULL, 0 };
+	fl_n = 0;
+	if (fl_or(&ps) >= 0) { fl_ws(&ps); if (*ps.p) ps.err = "unexpected text"; }
+	if (ps.err) { *err = ps.err; *col = (int)(ps.p - src) + 1; fl_n = 0; return -1; }
+	return 0;
+}
+
+static int fl_get(const event_t *e, int f)
+{
+	switch (f) {
+	case 0: return (int)e->type;
+	case 1: return e->x;
+	case 2: return e->y;
+	case 3: return e->button;
+	case 4: return e->mods;
+	case 5: return e->src;
+	case 6: return e->key;
+	default: return e->delta;
+	}
+}
+
+static int fl_test(int a, int cmp, int b)
+{
+	switch (cmp) {
+	case FL_EQ: return a == b;
+	case FL_NE: return a != b;
+	case FL_LT: return a < b;
+	case FL_LE: return a <= b;
+	case FL_GT: return a > b;
+	default: return a >= b;
+	}
+}
+
+/* run the program on e; no program keeps everything */
+static int fl_match(const event_t *e)
+{
+	int st[FL_MAX], sp = 0;
+	for (int pc = 0; pc < fl_n; ++pc) {
+		const struct fl_op *o = &fl_prog[pc];
+		switch (o->op) {
+		case FL_FCMP: st[sp++] = fl_test(fl_get(e, o->field), o->cmp, o->v); break;
+		case FL_FIELD: st[sp++] = fl_get(e, o->field); break;
+		case FL_CONST: st[sp++] = o->v; break;
+		case FL_CMP: sp--; st[sp - 1] = fl_test(st[sp - 1], o->cmp, st[sp]); break;
+		case FL_AND: sp--; st[sp - 1] &= st[sp]; break;
+		case FL_NOT: st[sp - 1] = !st[sp - 1]; break;
+		case FL_TRUTH: st[sp - 1] = st[sp - 1] != 0; break;
+		case FL_JF: if (!st[sp - 1]) pc = o->v - 1; else sp--; break;
+		default: if (st[sp - 1]) pc = o->v - 1; else sp--; break;   /* FL_JT */
+		}
+	}
+	return !fl_n || st[0];
+}
+
+/* help */
+static void print_help(const char *me)
+{
+	fprintf(stderr,
+"mouse-tool v1.0 (c) Kamil BuriXon Burek 2026\n"
+"Capture mouse clicks and movements, retrieve click positions, and record mouse activity directly in the terminal.\n\n"
+"Usage:\n"
+"  %s [options]\n"
+"  %s analyze [--from SEC] [--to SEC] [--region X0,Y0,X1,Y1] [--json] [-J N] FILE|DIR...\n"
+"  %s convert [--to jsonl|csv|arrow] [--batch N] [-o FILE [-O]] [-J N] FILE|DIR...\n"
+"  %s merge [--to jsonl|csv] [-o FILE [-O]] FILE|DIR...\n"
+"  %s index [--bucket SEC] FILE...\n"
+"  %s query [--from SEC] [--to SEC] [--region X0,Y0,X1,Y1] [--type press,release,motion,scroll,key,focus,paste,dwell] [--count] FILE...\n"
+"  %s compact [--full SEC] [--coarse SEC] [--tile SEC] [--cell WxH] [--epsilon CELLS] FILE...\n"
+"  %s compare [--band N] [--threshold CELLS] [--json] GOLDEN FRESH\n"
+"  %s metrics --regions FILE [--aspect R] [--json] LOG\n"
+"  %s menu [--layout row|column] [--at ROW,COL] [--gap N] [--pad N] [--style SGR] [--hover [--hover-style SGR]] [--index] [--timeout SEC] [[ID=]LABEL[@ROW,COL]...]\n\n"
+"Options:\n"
+"  -i, --infinite           keep running, print unique X,Y per change\n"
+"  -n, --count N            stop after N outputs (exclusive with --infinite)\n"
+"  -c, --click N            detect N clicks of one button at same/near position (<=0.5s gap) and print last click (or none on timeout/mismatch)\n"
+"  -m, --mark               draw a dot at click position (works in any mode)\n"
+"  -r, --record SEC         record SEC seconds then playback colorized (old->red, new->green)\n"
+"  -j, --json               collect history and emit JSON at exit\n"
+"  -p, --pretty-json        same as --json but pretty-printed\n"
+"  -l, --jsonl              newline-delimited JSON output (streaming)\n"
+"  -o, --outfile FILE       append outputs to FILE or create it\n"
+"  -a, --append             append to existing outfile (use with -o)\n"
+"  -O, --overwrite          overwrite existing outfile (use with -o)\n"
+"  -k, --keys               also report keys and bracketed pastes\n"
+"      --focus              also report terminal focus in/out\n"
+"      --scroll-coalesce MS merge wheel bursts within MS into one scroll event (delta + velocity)\n"
+"      --idle-timeout SEC   stop normally after SEC without input events\n"
+"      --max-duration SEC   stop normally after SEC\n"
+"      --flush-interval MS  flush streamed output every MS instead of per event\n"
+"      --stats-interval SEC print event counters to stderr every SEC\n"
+"  -T, --timestamps         add absolute unix timestamps (\"ts\" / last CSV column)\n"
+"      --clock NAME         event clock: monotonic (default), raw, boottime, tsc\n"
+"      --metrics ADDR       serve Prometheus metrics on unix:PATH or [127.0.0.1:]PORT\n"
+"      --control PATH       accept live commands on unix socket PATH (pause, resume, snapshot, ...)\n"
+"      --script FILE        replay timed input from FILE on a virtual clock instead of a terminal\n"
+"      --filter EXPR        keep only events matching EXPR, e.g. 'type==press && button==left && x>=5'\n"
+"      --debounce MS[,DUP] drop duplicate (within DUP ms) and chattering (release+press within MS) mouse reports, repair unpaired press/release\n"
+"      --dwell R,MS         report \"dwell\" start/end when the pointer rests within R cells for MS\n"
+"      --dwell-cell WxH     block size for dwell time totals (default 8x4)\n"
+"      --dwell-map FILE     write dwell time per block to FILE at exit (CSV)\n"
+"      --bind SPEC          'REGION TRIGGER CMD': run CMD (sh -c) on TRIGGER inside REGION (repeatable, or @FILE)\n"
+"      --bind-jobs N        run at most N --bind commands at once (default 4)\n"
+"      --tty PATH           read this terminal instead of the controlling one (repeatable; adds \"src\")\n"
+"  -N, --no-warn            suppress warnings\n"
+"  -h, --help               show this help\n\n"
+"Short options may be combined (e.g. -im or -mn7).\n"
+"CSV mode streams lines \"X,Y,button,mods\" (default); keys, focus and pastes as \"key,NAME,MODS\", \"focus,in|out\", \"paste,LEN\";\n"
+"dwells as \"dwell,start|end,X,Y,SEC\".\n"
+"JSON modes produce JSON metadata + events at exit; --jsonl streams newline-delimited JSON lines.\n"
+"Press Enter during continuous/recording to stop listening and finish normally (dump & playback).\n"
+"Exit codes: 0 ok, 1 general error / -c failure, 2 invalid parameter, 3 file not writable, 4 file exists.\n",
+	me, me, me, me, me, me, me, me, me, me);
+}
+
+/* offline analysis ("mouse-tool analyze FILE..."): a scanner for exactly the tool's own
+   JSONL / JSON / CSV output, reading mapped files in place without copying records.
+   Event time is "ts" when present (-T), else the running sum of "dt" (JSON only). */
+struct arec {
+	int type, x, y, button, src, mods, delta, key;   /* key: key code, focus in (1), paste length */
+	int has_xy, has_t, has_dt, has_src;
+	unsigned count;   /* events a compacted heat tile stands for (0: one) */
+	double t, dt;
+	const char *s; size_t sn;   /* key name or paste text, still JSON-escaped */
+};
+
+/* scan state of one input range: running time for dt-only logs (rel: times came from it) */
+struct ascan { double cum_dt; int rel; };
+
+/* counts, durations, per-button presses, click intervals and bounding box; partial
+   aggregates of consecutive inputs combine with agg_merge(). span is the summed dt of
+   the range; when rel, its times start at the range and are shifted on merge. */
+struct agg {
+	unsigned long long lines, bad, events, by_type[16], presses[16];
+	int have_t; double t_first, t_last;
+	int have_press; double press_first, press_last;
+	unsigned long long iv_n; double iv_sum, iv_min, iv_max;
+	int have_box; int x0, y0, x1, y1;
+	int rel; double span;
+};
+
+struct afilter {
+	int have_from, have_to, region;
+	double from, to;
+	int x0, y0, x1, y1;
+};
+
+static void agg_interval(struct agg *a, double iv)
+{
+	if (!a->iv_n || iv < a->iv_min) a->iv_min = iv;
+	if (!a->iv_n || iv > a->iv_max) a->iv_max = iv;
+	a->iv_n++; a->iv_sum += iv;
+}
+
+static void agg_add(struct agg *a, const struct arec *r, const struct afilter *f)
+{
+	if ((f->have_from || f->have_to) && (!r->has_t || (f->have_from && r->t < f->from) || (f->have_to && r->t > f->to))) return;
+	if (f->region && (!r->has_xy || r->x < f->x0 || r->x > f->x1 || r->y < f->y0 || r->y > f->y1)) return;
+	a->events += r->count ? r->count : 1;
+	a->by_type[r->type & 15] += r->count ? r->count : 1;
+	if (r->has_t) {
+		if (!a->have_t) { a->t_first = r->t; a->have_t = 1; }
+		a->t_last = r->t;
+	}
+	if (r->type == EVT_PRESS) {
+		a->presses[r->button & 15]++;
+		if (r->has_t) {
+			if (a->have_press) agg_interval(a, r->t - a->press_last);
+			else { a->press_first = r->t; a->have_press = 1; }
+			a->press_last = r->t;
+		}
+	}
+	if (r->has_xy && r->type != EVT_KEY && r->type != EVT_FOCUS && r->type != EVT_PASTE) {
+		if (!a->have_box) { a->x0 = a->x1 = r->x; a->y0 = a->y1 = r->y; a->have_box = 1; }
+		if (r->x < a->x0) a->x0 = r->x;
+		if (r->x > a->x1) a->x1 = r->x;
+		if (r->y < a->y0) a->y0 = r->y;
+		if (r->y > a->y1) a->y1 = r->y;
+	}
+}
+
+/* fold b (the input that follows a) into a */
+static void agg_merge(struct agg *a, const struct agg *b)
+{
+	double off = b->rel ? a->span : 0.0;
+	a->lines += b->lines; a->bad += b->bad; a->events += b->events;
+	for (int i = 0; i < 16; ++i) a->by_type[i] += b->by_type[i];
+	for (int i = 0; i < 16; ++i) a->presses[i] += b->presses[i];
+	if (b->have_t) {
+		if (!a->have_t) { a->t_first = b->t_first + off; a->have_t = 1; }
+		a->t_last = b->t_last + off;
+	}
+	if (b->have_press) {
+		if (a->have_press) agg_interval(a, b->press_first + off - a->press_last);
+		else { a->press_first = b->press_first + off; a->have_press = 1; }
+		a->press_last = b->press_last + off;
+	}
+	if (b->iv_n) {
+		if (!a->iv_n || b->iv_min < a->iv_min) a->iv_min = b->iv_min;
+		if (!a->iv_n || b->iv_max > a->iv_max) a->iv_max = b->iv_max;
+		a->iv_n += b->iv_n; a->iv_sum += b->iv_sum;
+	}
+	if (b->have_box) {
+		if (!a->have_box) { a->x0 = b->x0; a->y0 = b->y0; a->x1 = b->x1; a->y1 = b->y1; a->have_box = 1; }
+		if (b->x0 < a->x0) a->x0 = b->x0;
+		if (b->x1 > a->x1) a->x1 = b->x1;
+		if (b->y0 < a->y0) a->y0 = b->y0;
+		if (b->y1 > a->y1) a->y1 = b->y1;
+	}
+	a->span += b->span; a->rel |= b->rel;
+}
+
+/* fixed-point number as written by this tool ("-12", "0.008000"); *ok = 0 if none */
+static const char *an_num(const char *p, const char *e, double *v, int *ok)
+{
+	int neg = 0; double x = 0.0; *ok = 0;
+	if (p < e && *p == '-') { neg = 1; ++p; }
+	while (p < e && *p >= '0' && *p <= '9') { x = x * 10.0 + (*p++ - '0'); *ok = 1; }
+	if (p < e && *p == '.') {
+		double s = 0.1;
+		for (++p; p < e && *p >= '0' && *p <= '9'; ++p, s *= 0.1) { x += (*p - '0') * s; *ok = 1; }
+	}
+	*v = neg ? -x : x;
+	return p;
+}
+
+static int an_type(const char *s, size_t n)
+{
+	static const char *const names[9] = { NULL, "press", "motion", "release", "scroll", "key", "focus", "paste", "dwell" };
+	for (int t = 1; t < 9; ++t) if (strlen(names[t]) == n && !memcmp(s, names[t], n)) return t;
+	return 0;
+}
+
+/* inverse of key_name() for a name as found in a log (JSON-escaped) */
+static int an_key(const char *s, size_t n)
+{
+	if (n == 5 && !memcmp(s, "comma", 5)) return ',';
+	if (n == 5 && !memcmp(s, "space", 5)) return ' ';
+	for (int k = KEY_UP; k < KEY_LAST; ++k) if (strlen(key_names[k - KEY_UP]) == n && !memcmp(s, key_names[k - KEY_UP], n)) return k;
+	if (n == 2 && *s == '\\') return (unsigned char)s[1];
+	return n == 1 ? (unsigned char)*s : '?';
+}
+
+/* JSON string body [s, s+n) unescaped into buf (as written by fput_json_str); returns length */
+static size_t an_unescape(const char *s, size_t n, char *buf, size_t cap)
+{
+	size_t o = 0;
+	for (size_t i = 0; i < n && o < cap; ++i) {
+		char c = s[i];
+		if (c == '\\' && i + 1 < n) {
+			c = s[++i];
+			if (c == 'n') c = '\n'; else if (c == 'r') c = '\r'; else if (c == 't') c = '\t';
+			else if (c == 'u' && i + 4 < n) { c = (char)strtol((char[]){ s[i+3], s[i+4], 0 }, NULL, 16); i += 4; }
+		}
+		buf[o++] = c;
+	}
+	return o;
+}
+
+/* one event object starting at p ('{'); returns the byte after '}', or NULL if malformed */
+static const char *an_json_obj(const char *p, const char *e, struct arec *r)
+{
+	memset(r, 0, sizeof(*r));
+	for (++p; p < e;) {
+		while (p < e && (*p == ' ' || *p == ',' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+		if (p < e && *p == '}') break;
+		if (p >= e || *p != '"') return NULL;
+		const char *k = ++p;
+		while (p < e && *p != '"') ++p;
+		size_t kn = (size_t)(p - k);
+		p++;
+		while (p < e && (*p == ':' || *p == ' ')) ++p;
+		if (p >= e) return NULL;
+		if (*p == '"') {
+			const char *v = ++p;
+			while (p < e && *p != '"') p += (*p == '\\') ? 2 : 1;
+			if (p >= e) return NULL;
+			if (kn == 4 && !memcmp(k, "type", 4)) r->type = an_type(v, (size_t)(p - v));
+			else if ((kn == 3 && !memcmp(k, "key", 3)) || (kn == 4 && !memcmp(k, "text", 4))) { r->s = v; r->sn = (size_t)(p - v); }
+			else if (kn == 5 && !memcmp(k, "focus", 5)) r->key = *v == 'i';
+			else if (kn == 5 && !memcmp(k, "state", 5)) r->key = *v == 's';
+			++p;
+			continue;
+		}
+		double v; int ok;
+		const char *q = an_num(p, e, &v, &ok);
+		if (!ok) { while (p < e && *p != ',' && *p != '}') ++p; continue; } /* true/false/null */
+		p = q;
+		if (kn == 1 && *k == 'x') { r->x = (int)v; r->has_xy = 1; }
+		else if (kn == 1 && *k == 'y') r->y = (int)v;
+		else if (kn == 6 && !memcmp(k, "button", 6)) r->button = (int)v;
+		else if (kn == 4 && !memcmp(k, "mods", 4)) r->mods = (int)v;
+		else if (kn == 5 && !memcmp(k, "delta", 5)) r->delta = (int)v;
+		else if (kn == 8 && !memcmp(k, "duration", 8)) r->delta = (int)(v * 1000.0 + 0.5);
+		else if (kn == 3 && !memcmp(k, "len", 3)) r->key = (int)v;
+		else if (kn == 5 && !memcmp(k, "count", 5)) r->count = (unsigned)v;
+		else if (kn == 3 && !memcmp(k, "src", 3)) { r->src = (int)v; r->has_src = 1; }
+		else if (kn == 2 && !memcmp(k, "ts", 2)) { r->t = v; r->has_t = 1; }
+		else if (kn == 2 && !memcmp(k, "dt", 2)) { r->dt = v; r->has_dt = 1; }
+	}
+	if (p >= e || !r->type) return NULL;
+	return p + 1;
+}
+
+/* one CSV line [p, e): "X,Y,button,mods", "key,NAME,MODS", "focus,in|out", "paste,LEN",
+   "dwell,start|end,X,Y,SEC";
+   trailing columns are the source id (integer) and/or the timestamp (has '.') */
+static int an_csv_line(const char *p, const char *e, struct arec *r)
+{
+	const char *f[8]; size_t fl[8]; int nf = 0;
+	while (nf < 8) {
+		const char *c = memchr(p, ',', (size_t)(e - p));
+		f[nf] = p; fl[nf] = (size_t)((c ? c : e) - p); nf++;
+		if (!c) break;
+		p = c + 1;
+	}
+	memset(r, 0, sizeof(*r));
+	double v; int ok, base;
+	if (fl[0] && ((*f[0] >= '0' && *f[0] <= '9') || *f[0] == '-')) {
+		if (nf < 4) return 0;
+		r->type = EVT_PRESS; r->has_xy = 1;
+		an_num(f[0], f[0] + fl[0], &v, &ok); r->x = (int)v;
+		an_num(f[1], f[1] + fl[1], &v, &ok); r->y = (int)v;
+		an_num(f[2], f[2] + fl[2], &v, &ok); r->button = (int)v;
+		an_num(f[3], f[3] + fl[3], &v, &ok); r->mods = (int)v;
+		base = 4;
+	} else {
+		r->type = an_type(f[0], fl[0]);
+		if (r->type < EVT_KEY) return 0;
+		base = r->type == EVT_KEY ? 3 : r->type == EVT_DWELL ? 5 : 2;
+		if (nf < base) return 0;
+		if (r->type == EVT_KEY) { r->s = f[1]; r->sn = fl[1]; an_num(f[2], f[2] + fl[2], &v, &ok); r->mods = (int)v; }
+		else if (r->type == EVT_DWELL) {
+			r->key = fl[1] && *f[1] == 's'; r->has_xy = 1;
+			an_num(f[2], f[2] + fl[2], &v, &ok); r->x = (int)v;
+			an_num(f[3], f[3] + fl[3], &v, &ok); r->y = (int)v;
+			an_num(f[4], f[4] + fl[4], &v, &ok); r->delta = (int)(v * 1000.0 + 0.5);
+		}
+		else if (r->type == EVT_FOCUS) r->key = fl[1] && *f[1] == 'i';
+		else { an_num(f[1], f[1] + fl[1], &v, &ok); r->key = (int)v; }
+	}
+	for (int i = base; i < nf; ++i) {
+		an_num(f[i], f[i] + fl[i], &v, &ok);
+		if (!ok) return 0;
+		if (memchr(f[i], '.', fl[i])) { r->t = v; r->has_t = 1; } else { r->src = (int)v; r->has_src = 1; }
+	}
+	return 1;
+}
+
+/* cursor over the records of [p, e): JSON (documents or JSONL) when it starts with '{' */
+struct acur { const char *p, *e; int json; const char *rec, *rec_end; };   /* rec: text of the last record */
+
+/* p at '{' opens a -j/-p document header ({"mode"... or pretty-printed {\n  "mode"...) */
+static int an_doc_header(const char *p, const char *e)
+{
+	if (p >= e || *p != '{') return 0;
+	for (++p; p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'); ++p) ;
+	return e - p > 6 && !memcmp(p, "\"mode\"", 6);
+}
+
+static void an_open(struct acur *c, const char *p, const char *e)
+{
+	while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+	c->p = p; c->e = e; c->json = p < e && *p == '{';
+}
+
+/* next record into r: 1, 0 for a malformed one, -1 at the end */
+static int an_next(struct acur *c, struct arec *r)
+{
+	const char *p = c->p, *e = c->e;
+	if (c->json) {
+		while ((p = memchr(p, '{', (size_t)(e - p)))) {
+			if (an_doc_header(p, e)) { /* -j/-p document header: events follow '[' */
+				const char *b = memchr(p, '[', (size_t)(e - p));
+				if (!b) break;
+				p = b; continue;
+			}
+			const char *q = an_json_obj(p, e, r);
+			c->p = q ? q : p + 1;
+			c->rec = p; c->rec_end = c->p;
+			return q != NULL;
+		}
+		c->p = e;
+		return -1;
+	}
+	while (p < e) {
+		const char *nl = memchr(p, '\n', (size_t)(e - p));
+		const char *le = nl ? nl : e;
+		const char *ce = le > p && le[-1] == '\r' ? le - 1 : le;
+		const char *b = p;
+		p = nl ? nl + 1 : e;
+		if (ce > b) { c->p = p; c->rec = b; c->rec_end = ce; return an_csv_line(b, ce, r); }
+	}
+	c->p = e;
+	return -1;
+}
+
+/* feed every record of [p, e) to fn (NULL for a malformed one) until it returns nonzero */
+static void an_scan(const char *p, const char *e, int (*fn)(void *u, const struct arec *r), void *u)
+{
+	struct acur c; struct arec r; int k;
+	an_open(&c, p, e);
+	while ((k = an_next(&c, &r)) >= 0) if (fn(u, k ? &r : NULL)) return;
+}
+
+struct an_range { struct agg *a; const struct afilter *f; struct ascan sc; };
+
+static int an_agg_rec(void *u, const struct arec *r)
+{
+	struct an_range *g = u;
+	g->a->lines++;
+	if (!r) { g->a->bad++; return 0; }
+	if (r->has_dt) g->sc.cum_dt += r->dt;
+	if (!r->has_t && r->has_dt) {
+		struct arec c = *r;
+		c.t = g->sc.cum_dt; c.has_t = 1; g->sc.rel = 1;
+		agg_add(g->a, &c, g->f);
+	} else agg_add(g->a, r, g->f);
+	return 0;
+}
+
+/* aggregate [p, e) into a */
+static void analyze_range(const char *p, const char *e, struct agg *a, const struct afilter *f)
+{
+	struct an_range g = { a, f, { 0.0, 0 } };
+	an_scan(p, e, an_agg_rec, &g);
+	a->span = g.sc.cum_dt; a->rel = g.sc.rel;
+}
+
+/* map path read-only (read it into memory when it cannot be mapped, e.g. a pipe).
+   returns 0, or -1 with errno set; *len 0 for an empty file */
+static int an_map(const char *path, const char **data, size_t *len, int *mapped)
+{
+	int fd = !strcmp(path, "-") ? dup(STDIN_FILENO) : open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	struct stat st;
+	*data = NULL; *len = 0; *mapped = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size > 0) {
+			void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m == MAP_FAILED) { int er = errno; close(fd); errno = er; return -1; }
+			posix_madvise(m, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+			*data = m; *len = (size_t)st.st_size; *mapped = 1;
+		}
+		close(fd);
+		return 0;
+	}
+	size_t cap = 0; char *buf = NULL; ssize_t r;
+	for (;;) {
+		if (*len == cap) {
+			cap = cap ? cap * 2 : 1 << 20;
+			char *t = realloc(buf, cap);
+			if (!t) { free(buf); close(fd); errno = ENOMEM; return -1; }
+			buf = t;
+		}
+		r = read(fd, buf + *len, cap - *len);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) break;
+		*len += (size_t)r;
+	}
+	int er = errno; close(fd);
+	if (r < 0) { free(buf); errno = er; return -1; }
+	*data = buf;
+	return 0;
+}
+
+static void an_unmap(const char *data, size_t len, int mapped)
+{
+	if (mapped) munmap((void *)data, len); else free((void *)data);
+}
+
+/* work-stealing pool for the offline subcommands: tasks are the indices [0, n). Every
+   worker starts with a contiguous slice and takes tasks from its front; a worker whose
+   slice runs dry steals the back half of another's. Results are kept per task, so the
+   caller merges them in task order and the outcome does not depend on scheduling. */
+struct pool;
+struct pool_worker { struct pool *p; pthread_t th; int started; pthread_mutex_t mu; int lo, hi; };
+struct pool {
+	int n, nw;
+	void (*fn)(void *u, int task);
+	void *u;
+	struct pool_worker *w;
+	unsigned char *done;
+	pthread_mutex_t mu; pthread_cond_t cv;   /* done[] changes */
+};
+
+static int pool_steal(struct pool_worker *self)
+{
+	struct pool *p = self->p;
+	int me = (int)(self - p->w);
+	for (int k = 1; k < p->nw; ++k) {
+		struct pool_worker *v = &p->w[(me + k) % p->nw];
+		pthread_mutex_lock(&v->mu);
+		if (v->lo < v->hi) {
+			int hi = v->hi, mid = v->lo + (v->hi - v->lo) / 2;
+			v->hi = mid;
+			pthread_mutex_unlock(&v->mu);
+			pthread_mutex_lock(&self->mu);
+			self->lo = mid + 1; self->hi = hi;
+			pthread_mutex_unlock(&self->mu);
+			return mid;
+		}
+		pthread_mutex_unlock(&v->mu);
+	}
+	return -1;
+}
+
+static void *pool_run(void *arg)
+{
+	struct pool_worker *self = arg;
+	struct pool *p = self->p;
+	for (;;) {
+		int t = -1;
+		pthread_mutex_lock(&self->mu);
+		if (self->lo < self->hi) t = self->lo++;
+		pthread_mutex_unlock(&self->mu);
+		if (t < 0 && (t = pool_steal(self)) < 0) break;
+		p->fn(p->u, t);
+		pthread_mutex_lock(&p->mu);
+		p->done[t] = 1;
+		pthread_cond_broadcast(&p->cv);
+		pthread_mutex_unlock(&p->mu);
+	}
+	return NULL;
+}
+
+/* start nw workers over n tasks; if no thread can be created the tasks run here.
+   returns 0, or -1 (ENOMEM) */
+static int pool_start(struct pool *p, int n, int nw, void (*fn)(void *, int), void *u)
+{
+	if (nw > n) nw = n;
+	if (nw < 1) nw = 1;
+	memset(p, 0, sizeof(*p));
+	p->n = n; p->nw = nw; p->fn = fn; p->u = u;
+	p->w = calloc((size_t)nw, sizeof(*p->w));
+	p->done = calloc((size_t)n + 1, 1);
+	if (!p->w || !p->done) { free(p->w); free(p->done); errno = ENOMEM; return -1; }
+	pthread_mutex_init(&p->mu, NULL); pthread_cond_init(&p->cv, NULL);
+	for (int i = 0; i < nw; ++i) {
+		p->w[i].p = p; pthread_mutex_init(&p->w[i].mu, NULL);
+		p->w[i].lo = (int)((long long)n * i / nw); p->w[i].hi = (int)((long long)n * (i + 1) / nw);
+	}
+	int started = 0;
+	for (int i = 0; i < nw; ++i) if ((p->w[i].started = pthread_create(&p->w[i].th, NULL, pool_run, &p->w[i]) == 0)) started++;
+	if (!started) pool_run(&p->w[0]);
+	return 0;
+}
+
+/* block until task t has finished */
+static void pool_wait(struct pool *p, int t)
+{
+	pthread_mutex_lock(&p->mu);
+	while (!p->done[t]) pthread_cond_wait(&p->cv, &p->mu);
+	pthread_mutex_unlock(&p->mu);
+}
+
+static void pool_join(struct pool *p)
+{
+	for (int i = 0; i < p->nw; ++i) if (p->w[i].started) pthread_join(p->w[i].th, NULL);
+	for (int i = 0; i < p->nw; ++i) pthread_mutex_destroy(&p->w[i].mu);
+	pthread_mutex_destroy(&p->mu); pthread_cond_destroy(&p->cv);
+	free(p->w); free(p->done);
+}
+
+/* inputs of an offline subcommand: FILE, DIR (every file below it, hidden ones skipped,
+   in name order) or - for stdin, each split into tasks of about AN_CHUNK bytes that end
+   at a record boundary. -j/-p documents stay whole. */
+#define AN_CHUNK (4u << 20)
+#define AN_DEPTH 32
+struct an_input { char *path; const char *data; size_t len; int mapped, json, ok; };
+struct an_task { int in; size_t off, end; };
+struct an_set {
+	struct an_input *in; int nin, capin;
+	struct an_task *t; int nt, capt;
+	int rc;
+};
+
+static int an_add_input(struct an_set *s, const char *path)
+{
+	if (s->nin == s->capin) {
+		int cap = s->capin ? s->capin * 2 : 16;
+		struct an_input *t = realloc(s->in, (size_t)cap * sizeof(*t));
+		if (!t) return -1;
+		s->in = t; s->capin = cap;
+	}
+	struct an_input *in = &s->in[s->nin];
+	memset(in, 0, sizeof(*in));
+	if (!(in->path = strdup(path))) return -1;
+	s->nin++;
+	return 0;
+}
+
+static int an_hidden(const struct dirent *d) { return d->d_name[0] != '.'; }
+
+static int an_collect(struct an_set *s, const char *path, int depth)
+{
+	struct stat st;
+	if (strcmp(path, "-") && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		struct dirent **list;
+		int n = depth < AN_DEPTH ? scandir(path, &list, an_hidden, alphasort) : -1;
+		if (n < 0) { print_error(3,"cannot read directory '%s': %s", path, depth < AN_DEPTH ? strerror(errno) : "too deep"); s->rc = 3; return 0; }
+		int rc = 0;
+		for (int i = 0; i < n; ++i) {
+			size_t l = strlen(path) + strlen(list[i]->d_name) + 2;
+			char *sub = malloc(l);
+			if (!sub || rc) rc = -1;
+			else {
+				snprintf(sub, l, "%s%s%s", path, path[strlen(path) - 1] == '/' ? "" : "/", list[i]->d_name);
+				rc = an_collect(s, sub, depth + 1);
+			}
+			free(sub); free(list[i]);
+		}
+		free(list);
+		return rc;
+	}
+	return an_add_input(s, path);
+}
+
+static int an_add_task(struct an_set *s, int in, size_t off, size_t end)
+{
+	if (s->nt == s->capt) {
+		int cap = s->capt ? s->capt * 2 : 64;
+		struct an_task *t = realloc(s->t, (size_t)cap * sizeof(*t));
+		if (!t) return -1;
+		s->t = t; s->capt = cap;
+	}
+	s->t[s->nt++] = (struct an_task){ in, off, end };
+	return 0;
+}
+
+/* map every input; one that cannot be read is reported and left out (ok = 0) */
+static void an_load(struct an_set *s)
+{
+	for (int i = 0; i < s->nin; ++i) {
+		struct an_input *in = &s->in[i];
+		if (an_map(in->path, &in->data, &in->len, &in->mapped) < 0) { print_error(3,"cannot read '%s': %s", in->path, strerror(errno)); s->rc = 3; in->data = NULL; continue; }
+		const char *p = in->data, *e = p + in->len;
+		while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+		in->json = p < e && *p == '{';
+		in->ok = 1;
+	}
+}
+
+/* cut the loaded inputs into tasks; whole keeps dt-only JSON logs in one piece
+   (their times are only known relative to the start of the file). returns 0 or -1 (ENOMEM) */
+static int an_plan(struct an_set *s, int whole)
+{
+	for (int i = 0; i < s->nin; ++i) {
+		struct an_input *in = &s->in[i];
+		if (!in->ok) continue;
+		const char *p = in->data, *e = p + in->len;
+		while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+		int split = !(in->json && an_doc_header(p, e));
+		if (split && whole && in->json) {
+			const char *nl = memchr(p, '\n', (size_t)(e - p));
+			const char *le = nl ? nl : e;
+			split = 0;
+			for (const char *q = p; !split && (q = memchr(q, '"', (size_t)(le - q))) && le - q >= 5; ++q) split = !memcmp(q, "\"ts\":", 5);
+		}
+		size_t off = 0;
+		do {
+			size_t end = in->len;
+			if (split && in->len - off > AN_CHUNK) {
+				const char *nl = memchr(in->data + off + AN_CHUNK, '\n', in->len - off - AN_CHUNK);
+				if (nl) end = (size_t)(nl - in->data) + 1;
+			}
+			if (an_add_task(s, i, off, end) < 0) return -1;
+			off = end;
+		} while (off < in->len);
+	}
+	return 0;
+}
+
+static void an_free(struct an_set *s)
+{
+	for (int i = 0; i < s->nin; ++i) {
+		if (s->in[i].data) an_unmap(s->in[i].data, s->in[i].len, s->in[i].mapped);
+		free(s->in[i].path);
+	}
+	free(s->in); free(s->t);
+}
+
+/* -J/--jobs N, else one worker per online CPU */
+static int an_jobs(const char *arg)
+{
+	long v;
+	if (arg) return parse_positive_int(arg, &v) && v <= 1024 ? (int)v : -1;
+	v = sysconf(_SC_NPROCESSORS_ONLN);
+	return v < 1 ? 1 : v > 1024 ? 1024 : (int)v;
+}
+
+static void agg_print(FILE *fp, const struct agg *a, int files, int json)
+{
+	static const char *const tn[9] = { "other", "press", "motion", "release", "scroll", "key", "focus", "paste", "dwell" };
+	double dur = a->have_t ? a->t_last - a->t_first : 0.0;
+	if (json) {
+		fprintf(fp, "{\"files\":%d,\"lines\":%llu,\"bad\":%llu,\"events\":%llu,\"duration\":%.6f,\"types\":{", files, a->lines, a->bad, a->events, dur);
+		for (int t = 1; t < 9; ++t) fprintf(fp, "%s\"%s\":%llu", t > 1 ? "," : "", tn[t], a->by_type[t]);
+		fprintf(fp, "},\"presses\":{");
+		for (int b = 0, first = 1; b < 16; ++b) if (a->presses[b]) { fprintf(fp, "%s\"%d\":%llu", first ? "" : ",", b, a->presses[b]); first = 0; }
+		fprintf(fp, "},\"click_interval\":{\"n\":%llu,\"mean\":%.6f,\"min\":%.6f,\"max\":%.6f}", a->iv_n,
+			a->iv_n ? a->iv_sum / (double)a->iv_n : 0.0, a->iv_min, a->iv_max);
+		if (a->have_box) fprintf(fp, ",\"bbox\":{\"x0\":%d,\"y0\":%d,\"x1\":%d,\"y1\":%d}", a->x0, a->y0, a->x1, a->y1);
+		fprintf(fp, "}\n");
+		return;
+	}
+	fprintf(fp, "files     %d\nlines     %llu (%llu unparsed)\nevents    %llu\nduration  %.6f s\ntypes    ", files, a->lines, a->bad, a->events, dur);
+	for (int t = 1; t < 9; ++t) if (a->by_type[t]) fprintf(fp, " %s=%llu", tn[t], a->by_type[t]);
+	fprintf(fp, "\npresses  ");
+	for (int b = 0; b < 16; ++b) if (a->presses[b]) fprintf(fp, " button%d=%llu", b, a->presses[b]);
+	if (a->iv_n) fprintf(fp, "\nclicks    n=%llu interval mean=%.6f min=%.6f max=%.6f s", a->iv_n + 1, a->iv_sum / (double)a->iv_n, a->iv_min, a->iv_max);
+	if (a->have_box) fprintf(fp, "\nbbox      x %d..%d  y %d..%d", a->x0, a->x1, a->y0, a->y1);
+	fputc('\n', fp);
+}
+
+struct an_job { struct an_set *s; const struct afilter *f; struct agg *aggs; };
+
+static void an_agg_task(void *u, int t)
+{
+	struct an_job *j = u;
+	const struct an_task *k = &j->s->t[t];
+	const char *d = j->s->in[k->in].data;
+	analyze_range(d + k->off, d + k->end, &j->aggs[t], j->f);
+}
+
+static int analyze_main(int argc, char **argv)
+{
+	struct afilter f; memset(&f, 0, sizeof(f));
+	int json = 0, jobs = an_jobs(NULL);
+	static struct option aopts[] = {
+		{"from", required_argument, NULL, 'f'},
+		{"to", required_argument, NULL, 't'},
+		{"region", required_argument, NULL, 'r'},
+		{"json", no_argument, NULL, 'j'},
+		{"jobs", required_argument, NULL, 'J'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "f:t:r:jJ:", aopts, NULL)) != -1) {
+		char *end;
+		if (ch == 'f' || ch == 't') {
+			errno = 0; double v = strtod(optarg, &end);
+			if (errno || end == optarg || *end) { print_error(2,"--from/--to require seconds"); return 2; }
+			if (ch == 'f') { f.from = v; f.have_from = 1; } else { f.to = v; f.have_to = 1; }
+		}
+		else if (ch == 'r') {
+			if (sscanf(optarg, "%d,%d,%d,%d", &f.x0, &f.y0, &f.x1, &f.y1) != 4 || f.x0 > f.x1 || f.y0 > f.y1) { print_error(2,"--region requires X0,Y0,X1,Y1"); return 2; }
+			f.region = 1;
+		}
+		else if (ch == 'j') json = 1;
+		else if (ch == 'J') { if ((jobs = an_jobs(optarg)) < 0) { print_error(2,"--jobs/-J requires 1..1024"); return 2; } }
+		else { print_error(2,"usage: analyze [--from SEC] [--to SEC] [--region X0,Y0,X1,Y1] [--json] [-J N] FILE|DIR..."); return 2; }
+	}
+	if (optind >= argc) { print_error(2,"analyze needs at least one FILE or DIR (or - for stdin)"); return 2; }
+	struct an_set s; memset(&s, 0, sizeof(s));
+	for (int i = optind; i < argc; ++i) if (an_collect(&s, argv[i], 0) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	an_load(&s);
+	if (an_plan(&s, f.have_from || f.have_to) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	struct an_job j = { &s, &f, calloc((size_t)s.nt + 1, sizeof(struct agg)) };
+	struct pool p;
+	if (!j.aggs || pool_start(&p, s.nt, jobs, an_agg_task, &j) < 0) { print_error(1,"out of memory"); free(j.aggs); an_free(&s); return 1; }
+	pool_join(&p);
+	struct agg total; memset(&total, 0, sizeof(total));
+	for (int t = 0; t < s.nt; ++t) agg_merge(&total, &j.aggs[t]);
+	int files = 0;
+	for (int i = 0; i < s.nin; ++i) files += s.in[i].ok;
+	agg_print(stdout, &total, files, json);
+	free(j.aggs);
+	int rc = s.rc;
+	an_free(&s);
+	return rc;
+}
+
+/* Arrow IPC file output ("convert --arrow"): one record batch per --batch rows with the
+   columns of AR_COLS, so dataframe tools can map the file and use the columns in place.
+   The flatbuffer metadata (Schema, Message, RecordBatch, Footer) is written by the small
+   builder below, which works back to front like the reference one: objects are prepended,
+   and a reference is the distance of an object from the end of the buffer. Flatbuffer
+   scalars are little-endian; the column data is native, and the schema says which. */
+struct fb { uint8_t *buf; size_t cap, len, minalign; int nvt, err; size_t tstart, vt[12]; };
+
+static void fb_grow(struct fb *b, size_t need)
+{
+	if (b->err || b->cap - b->len >= need) return;
+	size_t cap = b->cap ? b->cap : 1024;
+	while (cap - b->len < need) cap *= 2;
+	uint8_t *nb = malloc(cap);
+	if (!nb) { b->err = ENOMEM; return; }
+	if (b->len) memcpy(nb + cap - b->len, b->buf + b->cap - b->len, b->len);
+	free(b->buf); b->buf = nb; b->cap = cap;
+}
+
+static void fb_push(struct fb *b, uint64_t v, size_t n)   /* prepend n little-endian bytes */
+{
+	fb_grow(b, n);
+	if (b->err) return;
+	b->len += n;
+	for (size_t i = 0; i < n; ++i, v >>= 8) b->buf[b->cap - b->len + i] = (uint8_t)v;
+}
+
+static void fb_align(struct fb *b, size_t size, size_t extra)   /* so that after extra more bytes, len % size == 0 */
+{
+	if (size > b->minalign) b->minalign = size;
+	while ((b->len + extra) & (size - 1)) fb_push(b, 0, 1);
+}
+
+static void fb_scalar(struct fb *b, uint64_t v, size_t n) { fb_align(b, n, 0); fb_push(b, v, n); }
+
+static void fb_uoff(struct fb *b, size_t ref) { fb_align(b, 4, 0); fb_push(b, b->len + 4 - ref, 4); }
+
+static size_t fb_string(struct fb *b, const char *s)
+{
+	size_t n = strlen(s);
+	fb_align(b, 4, n + 1);
+	fb_push(b, 0, 1);
+	for (size_t i = n; i-- > 0;) fb_push(b, (uint8_t)s[i], 1);
+	fb_push(b, n, 4);
+	return b->len;
+}
+
+/* vectors: fb_vec_start, prepend the elements last to first, fb_vec_end */
+static void fb_vec_start(struct fb *b, size_t elem, size_t n, size_t align) { fb_align(b, 4, elem * n); fb_align(b, align, elem * n); }
+static size_t fb_vec_end(struct fb *b, size_t n) { fb_push(b, n, 4); return b->len; }
+
+static size_t fb_offvec(struct fb *b, const size_t *refs, size_t n)
+{
+	fb_vec_start(b, 4, n, 4);
+	for (size_t i = n; i-- > 0;) fb_uoff(b, refs[i]);
+	return fb_vec_end(b, n);
+}
+
+/* tables: fb_start, fb_field/fb_field_off per present field, fb_end */
+static void fb_start(struct fb *b, int nfields) { b->nvt = nfields; b->tstart = b->len; memset(b->vt, 0, sizeof(b->vt)); }
+static void fb_field(struct fb *b, int id, uint64_t v, size_t n) { fb_scalar(b, v, n); b->vt[id] = b->len; }
+static void fb_field_off(struct fb *b, int id, size_t ref) { fb_uoff(b, ref); b->vt[id] = b->len; }
+
+static size_t fb_end(struct fb *b)
+{
+	fb_scalar(b, 0, 4);   /* soffset to the vtable, patched below */
+	size_t t = b->len;
+	for (int i = b->nvt; i-- > 0;) fb_push(b, b->vt[i] ? t - b->vt[i] : 0, 2);
+	fb_push(b, t - b->tstart, 2);
+	fb_push(b, 4 + 2 * (size_t)b->nvt, 2);
+	if (!b->err) {
+		uint32_t so = (uint32_t)(b->len - t);   /* vtable precedes the table */
+		for (int i = 0; i < 4; ++i) b->buf[b->cap - t + i] = (uint8_t)(so >> (8 * i));
+	}
+	return t;
+}
+
+static void fb_finish(struct fb *b, size_t root) { fb_align(b, b->minalign > 8 ? b->minalign : 8, 4); fb_uoff(b, root); }
+
+static const uint8_t *fb_data(const struct fb *b) { return b->buf + b->cap - b->len; }
+
+/* columns: name, width in bytes, Arrow type (2 Int, 10 Timestamp, 18 Duration), signed, nullable */
+enum { AR_TYPE, AR_BUTTON, AR_MODS, AR_X, AR_Y, AR_VALUE, AR_COUNT, AR_SRC, AR_TS, AR_DT, AR_NCOL };
+static const struct ar_col { const char *name; int width, type, sign, nullable; } AR_COLS[AR_NCOL] = {
+	{"type", 1, 2, 0, 0}, {"button", 1, 2, 0, 0}, {"mods", 1, 2, 0, 0},
+	{"x", 2, 2, 1, 1}, {"y", 2, 2, 1, 1},
+	{"value", 4, 2, 1, 0}, {"count", 4, 2, 0, 0}, {"src", 2, 2, 0, 1},
+	{"ts", 8, 10, 1, 1}, {"dt", 8, 18, 1, 0},
+};
+
+static size_t ar_schema(struct fb *b)
+{
+	size_t fields[AR_NCOL];
+	for (int i = 0; i < AR_NCOL; ++i) {
+		const struct ar_col *c = &AR_COLS[i];
+		size_t tz = c->type == 10 ? fb_string(b, "UTC") : 0, ty;
+		fb_start(b, 2);
+		if (c->type == 2) { fb_field(b, 0, (uint64_t)c->width * 8, 4); fb_field(b, 1, (uint64_t)c->sign, 1); }
+		else { fb_field(b, 0, 2, 2); if (tz) fb_field_off(b, 1, tz); }   /* unit MICROSECOND */
+		ty = fb_end(b);
+		size_t name = fb_string(b, c->name);
+		fb_vec_start(b, 4, 0, 4);
+		size_t children = fb_vec_end(b, 0);
+		fb_start(b, 6);
+		fb_field_off(b, 0, name);
+		fb_field_off(b, 3, ty);
+		fb_field_off(b, 5, children);
+		fb_field(b, 1, (uint64_t)c->nullable, 1);
+		fb_field(b, 2, (uint64_t)c->type, 1);
+		fields[i] = fb_end(b);
+	}
+	size_t vec = fb_offvec(b, fields, AR_NCOL);
+	const uint16_t one = 1;
+	fb_start(b, 2);
+	fb_field_off(b, 1, vec);
+	fb_field(b, 0, *(const uint8_t *)&one ? 0 : 1, 2);   /* endianness of the column data */
+	return fb_end(b);
+}
+
+/* a Message (Arrow metadata V5) around header, with the body that follows it */
+static void ar_message(struct fb *b, int header_type, size_t header, uint64_t body)
+{
+	fb_start(b, 4);
+	fb_field(b, 3, body, 8);
+	fb_field_off(b, 2, header);
+	fb_field(b, 0, 4, 2);
+	fb_field(b, 1, (uint64_t)header_type, 1);
+	fb_finish(b, fb_end(b));
+}
+
+struct ar_row { int64_t ts, dt; int32_t value; uint32_t count; int16_t x, y; uint16_t src; uint8_t type, button, mods, has_ts, has_xy, has_src; };
+
+struct ar_block { uint64_t off, body; uint32_t meta; };
+struct ar_writer {
+	FILE *fp; uint64_t pos; int err;
+	size_t batch, n; struct ar_row *rows;   /* pending rows of the next batch */
+	struct ar_block *blk; size_t nblk, cap;
+	uint8_t *col; size_t col_cap;
+};
+
+static void ar_write(struct ar_writer *w, const void *p, size_t n)
+{
+	if (w->err || !n) return;
+	if (fwrite(p, 1, n, w->fp) != n) w->err = errno ? errno : EIO;
+	w->pos += n;
+}
+
+static void ar_u32(struct ar_writer *w, uint32_t v)
+{
+	uint8_t le[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	ar_write(w, le, 4);
+}
+
+/* continuation marker, metadata length and the metadata (a multiple of 8 bytes);
+   returns the bytes written */
+static uint32_t ar_meta(struct ar_writer *w, const struct fb *b)
+{
+	ar_u32(w, 0xffffffffu);
+	ar_u32(w, (uint32_t)b->len);
+	ar_write(w, fb_data(b), b->len);
+	return (uint32_t)(8 + b->len);
+}
+
+static size_t ar_pad(size_t n) { return (n + 63) & ~(size_t)63; }
+
+static void ar_flush(struct ar_writer *w)
+{
+	size_t n = w->n, bits = ar_pad((n + 7) / 8), off = 0;
+	uint64_t nodes[AR_NCOL][2], bufs[AR_NCOL][4];
+	if (!n || w->err) return;
+	w->n = 0;
+	for (int i = 0; i < AR_NCOL; ++i) {
+		const struct ar_col *c = &AR_COLS[i];
+		size_t nulls = 0;
+		for (size_t r = 0; c->nullable && r < n; ++r) nulls += i == AR_TS ? !w->rows[r].has_ts : i == AR_SRC ? !w->rows[r].has_src : !w->rows[r].has_xy;
+		nodes[i][0] = n; nodes[i][1] = nulls;
+		bufs[i][0] = off; bufs[i][1] = nulls ? (n + 7) / 8 : 0; off += nulls ? bits : 0;
+		bufs[i][2] = off; bufs[i][3] = n * (size_t)c->width; off += ar_pad(n * (size_t)c->width);
+	}
+	if (w->nblk == w->cap) {
+		struct ar_block *nb = realloc(w->blk, (w->cap = w->cap ? w->cap * 2 : 16) * sizeof(*nb));
+		if (!nb) { w->err = ENOMEM; return; }
+		w->blk = nb;
+	}
+	struct fb b; memset(&b, 0, sizeof(b));
+	fb_vec_start(&b, 16, 2 * AR_NCOL, 8);
+	for (int i = 2 * AR_NCOL; i-- > 0;) { fb_push(&b, bufs[i / 2][2 * (i & 1) + 1], 8); fb_push(&b, bufs[i / 2][2 * (i & 1)], 8); }
+	size_t bv = fb_vec_end(&b, 2 * AR_NCOL);
+	fb_vec_start(&b, 16, AR_NCOL, 8);
+	for (int i = AR_NCOL; i-- > 0;) { fb_push(&b, nodes[i][1], 8); fb_push(&b, nodes[i][0], 8); }
+	size_t nv = fb_vec_end(&b, AR_NCOL);
+	fb_start(&b, 3);
+	fb_field(&b, 0, n, 8);
+	fb_field_off(&b, 1, nv);
+	fb_field_off(&b, 2, bv);
+	ar_message(&b, 3, fb_end(&b), off);
+	if (b.err) { w->err = b.err; free(b.buf); return; }
+	struct ar_block *k = &w->blk[w->nblk++];
+	k->off = w->pos; k->body = off;
+	k->meta = ar_meta(w, &b);
+	free(b.buf);
+	/* body: every column transposed out of the rows into one scratch buffer */
+	if (w->col_cap < bits + ar_pad(n * 8)) {
+		free(w->col);
+		if (!(w->col = malloc(w->col_cap = bits + ar_pad(n * 8)))) { w->col_cap = 0; w->err = ENOMEM; return; }
+	}
+	for (int i = 0; i < AR_NCOL; ++i) {
+		const struct ar_col *c = &AR_COLS[i];
+		uint8_t *d = w->col;
+		if (nodes[i][1]) {
+			memset(d, 0, bits);
+			for (size_t r = 0; r < n; ++r) {
+				const struct ar_row *o = &w->rows[r];
+				if (i == AR_TS ? o->has_ts : i == AR_SRC ? o->has_src : o->has_xy) d[r >> 3] |= (uint8_t)(1u << (r & 7));
+			}
+			ar_write(w, d, bits);
+		}
+		for (size_t r = 0; r < n; ++r) {
+			const struct ar_row *o = &w->rows[r];
+			switch (i) {
+			case AR_TYPE: d[r] = o->type; break;
+			case AR_BUTTON: d[r] = o->button; break;
+			case AR_MODS: d[r] = o->mods; break;
+			case AR_X: ((int16_t *)d)[r] = o->x; break;
+			case AR_Y: ((int16_t *)d)[r] = o->y; break;
+			case AR_VALUE: ((int32_t *)d)[r] = o->value; break;
+			case AR_COUNT: ((uint32_t *)d)[r] = o->count; break;
+			case AR_SRC: ((uint16_t *)d)[r] = o->src; break;
+			case AR_TS: ((int64_t *)d)[r] = o->ts; break;
+			default: ((int64_t *)d)[r] = o->dt; break;
+			}
+		}
+		memset(d + n * (size_t)c->width, 0, ar_pad(n * (size_t)c->width) - n * (size_t)c->width);
+		ar_write(w, d, ar_pad(n * (size_t)c->width));
+	}
+}
+
+static int ar_open(struct ar_writer *w, FILE *fp, size_t batch)
+{
+	memset(w, 0, sizeof(*w));
+	w->fp = fp; w->batch = batch;
+	if (!(w->rows = malloc(batch * sizeof(*w->rows)))) return -1;
+	struct fb b; memset(&b, 0, sizeof(b));
+	ar_message(&b, 1, ar_schema(&b), 0);
+	if (b.err) { free(b.buf); return -1; }
+	ar_write(w, "ARROW1\0", 8);
+	ar_meta(w, &b);
+	free(b.buf);
+	return 0;
+}
+
+static void ar_add(struct ar_writer *w, const struct ar_row *r, size_t n)
+{
+	while (n && !w->err) {
+		size_t k = w->batch - w->n < n ? w->batch - w->n : n;
+		memcpy(w->rows + w->n, r, k * sizeof(*r));
+		w->n += k; r += k; n -= k;
+		if (w->n == w->batch) ar_flush(w);
+	}
+}
+
+/* last batch, end-of-stream marker and the footer; returns 0 or an errno value */
+static int ar_close(struct ar_writer *w)
+{
+	ar_flush(w);
+	ar_u32(w, 0xffffffffu);
+	ar_u32(w, 0);
+	struct fb b; memset(&b, 0, sizeof(b));
+	size_t schema = ar_schema(&b);
+	fb_vec_start(&b, 24, w->nblk, 8);
+	for (size_t i = w->nblk; i-- > 0;) { fb_push(&b, w->blk[i].body, 8); fb_push(&b, w->blk[i].meta, 8); fb_push(&b, w->blk[i].off, 8); }
+	size_t bv = fb_vec_end(&b, w->nblk);
+	fb_start(&b, 4);
+	fb_field_off(&b, 1, schema);
+	fb_field_off(&b, 3, bv);
+	fb_field(&b, 0, 4, 2);
+	fb_finish(&b, fb_end(&b));
+	if (b.err && !w->err) w->err = b.err;
+	if (!b.err) ar_write(w, fb_data(&b), b.len);
+	ar_u32(w, (uint32_t)b.len);
+	ar_write(w, "ARROW1", 6);
+	free(b.buf); free(w->rows); free(w->blk); free(w->col);
+	return w->err;
+}
+
+/* "mouse-tool convert": re-emit logs as JSONL or CSV with the tool's own formatters, or as
+   an Arrow IPC file. Every task formats (or, for Arrow, decodes into rows) its range in
+   memory and the results are written in task order.
+   "ts"/src are kept when the first record carries them; CSV keeps only the records CSV
+   output has (presses, key/focus/paste), and CSV input gets dt from consecutive "ts". */
+struct cv_job {
+	struct an_set *s;
+	int csv, arrow;
+	struct cv_out { char *buf; size_t len; struct ar_row *rows; size_t nrows, rcap; unsigned long long bad; int err; } *out;
+};
+
+struct cv_range { FILE *fp; struct cv_out *o; int csv, arrow; unsigned long long bad; int have_prev; double prev; char text[PASTE_MAX]; };
+
+static int64_t cv_us(double s) { return (int64_t)(s < 0 ? s * 1e6 - 0.5 : s * 1e6 + 0.5); }
+
+static int cv_row(struct cv_out *o, const struct arec *r, double dt)
+{
+	if (o->nrows == o->rcap) {
+		struct ar_row *nr = realloc(o->rows, (o->rcap = o->rcap ? o->rcap * 2 : 4096) * sizeof(*nr));
+		if (!nr) { o->err = ENOMEM; return 1; }
+		o->rows = nr;
+	}
+	struct ar_row *w = &o->rows[o->nrows++];
+	memset(w, 0, sizeof(*w));
+	w->type = (uint8_t)r->type; w->button = (uint8_t)r->button; w->mods = (uint8_t)r->mods;
+	w->has_xy = (uint8_t)r->has_xy; w->x = (int16_t)r->x; w->y = (int16_t)r->y;
+	w->value = r->type == EVT_KEY ? an_key(r->s, r->sn) : r->type == EVT_SCROLL || r->type == EVT_DWELL ? r->delta : r->key;
+	if (r->type == EVT_DWELL) w->button = (uint8_t)r->key;
+	w->count = r->count ? r->count : 1;
+	w->has_src = (uint8_t)r->has_src; w->src = (uint16_t)r->src;
+	w->has_ts = (uint8_t)r->has_t; w->ts = r->has_t ? cv_us(r->t) : 0;
+	w->dt = cv_us(dt);
+	return 0;
+}
+
+/* write r as one output record with time t (seconds, for "ts") and source src;
+   text is scratch space for a paste's unescaped data */
+static void an_emit(FILE *fp, int csv, const struct arec *r, double t, int src, double dt, char *text)
+{
+	if (csv && r->type != EVT_PRESS && r->type < EVT_KEY) return;
+	event_t e; memset(&e, 0, sizeof(e));
+	e.type = (evtype_t)r->type; e.x = r->x; e.y = r->y; e.button = r->button; e.mods = r->mods; e.delta = r->delta;
+	e.key = r->type == EVT_KEY ? an_key(r->s, r->sn) : r->key;
+	e.src = src;
+	e.t = t > 0.0 ? (uint64_t)(t * 1e9 + 0.5) : 0;
+	if (csv) { fprint_event_csv(fp, &e); return; }
+	if (r->type == EVT_PASTE && r->s) fprint_event_json_text(fp, &e, dt, ",", text, an_unescape(r->s, r->sn, text, PASTE_MAX));
+	else fprint_event_json(fp, &e, dt, ",");
+	fputc('\n', fp);
+}
+
+static int cv_rec(void *u, const struct arec *r)
+{
+	struct cv_range *c = u;
+	if (!r) { c->bad++; return 0; }
+	double dt = r->has_dt ? r->dt : r->has_t && c->have_prev ? r->t - c->prev : 0.0;
+	if (r->has_t) { c->prev = r->t; c->have_prev = 1; }
+	if (c->arrow) return cv_row(c->o, r, dt);
+	an_emit(c->fp, c->csv, r, r->has_t ? r->t : 0.0, r->src, dt, c->text);
+	return 0;
+}
+
+static int cv_first(void *u, const struct arec *r) { if (r) *(struct arec *)u = *r; return r != NULL; }
+static int cv_last(void *u, const struct arec *r) { if (r) *(struct arec *)u = *r; return 0; }
+
+static void cv_task(void *u, int t)
+{
+	struct cv_job *j = u;
+	const struct an_task *k = &j->s->t[t];
+	const struct an_input *in = &j->s->in[k->in];
+	struct cv_out *o = &j->out[t];
+	struct cv_range *c = malloc(sizeof(*c));
+	FILE *fp = c && !j->arrow ? open_memstream(&o->buf, &o->len) : NULL;
+	if (!c || (!fp && !j->arrow)) { free(c); o->err = ENOMEM; return; }
+	memset(c, 0, offsetof(struct cv_range, text));
+	c->fp = fp; c->o = o; c->csv = j->csv; c->arrow = j->arrow;
+	if (k->off && !in->json) { /* dt of the first CSV line needs the last line of the previous range */
+		const char *e = in->data + k->off - 1, *b = e;
+		while (b > in->data && b[-1] != '\n') --b;
+		struct arec r; r.has_t = 0;
+		an_scan(b, e, cv_last, &r);
+		if (r.has_t) { c->prev = r.t; c->have_prev = 1; }
+	}
+	an_scan(in->data + k->off, in->data + k->end, cv_rec, c);
+	o->bad = c->bad;
+	if (fp && fclose(fp) != 0) o->err = errno ? errno : ENOMEM;
+	free(c);
+}
+
+/* -o FILE of convert/merge: refuses an existing file unless -O; returns 0 or the exit code */
+static int an_outfile(const char *path, int overwrite, FILE **fp)
+{
+	struct stat st;
+	if (!overwrite && stat(path, &st) == 0) { print_error(4,"output file '%s' exists (use -O to overwrite)", path); return 4; }
+	if (!(*fp = fopen(path, "w"))) { print_error(3,"cannot open output file '%s': %s", path, strerror(errno)); return 3; }
+	return 0;
+}
+
+static int convert_main(int argc, char **argv)
+{
+	int csv = 0, arrow = 0, overwrite = 0, jobs = an_jobs(NULL), rc;
+	long batch = 65536;
+	const char *out_path = NULL;
+	static struct option copts[] = {
+		{"to", required_argument, NULL, 't'},
+		{"arrow", no_argument, NULL, 'A'},
+		{"batch", required_argument, NULL, 'b'},
+		{"outfile", required_argument, NULL, 'o'},
+		{"overwrite", no_argument, NULL, 'O'},
+		{"jobs", required_argument, NULL, 'J'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "t:Ab:o:OJ:", copts, NULL)) != -1) {
+		if (ch == 't') {
+			csv = !strcmp(optarg, "csv"); arrow = !strcmp(optarg, "arrow");
+			if (!csv && !arrow && strcmp(optarg, "jsonl")) { print_error(2,"--to requires csv, jsonl or arrow"); return 2; }
+		}
+		else if (ch == 'A') { arrow = 1; csv = 0; }
+		else if (ch == 'b') { if (!parse_positive_int(optarg, &batch) || batch > (1L << 24)) { print_error(2,"--batch requires 1..16777216 rows"); return 2; } }
+		else if (ch == 'o') out_path = optarg;
+		else if (ch == 'O') overwrite = 1;
+		else if (ch == 'J') { if ((jobs = an_jobs(optarg)) < 0) { print_error(2,"--jobs/-J requires 1..1024"); return 2; } }
+		else { print_error(2,"usage: convert [--to jsonl|csv|arrow] [--arrow] [--batch N] [-o FILE [-O]] [-J N] FILE|DIR..."); return 2; }
+	}
+	if (optind >= argc) { print_error(2,"convert needs at least one FILE or DIR (or - for stdin)"); return 2; }
+	FILE *fp = stdout;
+	if (arrow && !out_path && isatty(STDOUT_FILENO)) { print_error(2,"--arrow writes a binary file; use -o FILE or redirect stdout"); return 2; }
+	if (out_path && (rc = an_outfile(out_path, overwrite, &fp))) return rc;
+	struct an_set s; memset(&s, 0, sizeof(s));
+	for (int i = optind; i < argc; ++i) if (an_collect(&s, argv[i], 0) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	an_load(&s);
+	if (an_plan(&s, 0) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	struct ar_writer aw;
+	if (arrow && ar_open(&aw, fp, (size_t)batch) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	for (int i = 0; i < s.nin; ++i) {
+		struct arec r; r.type = 0;
+		if (s.in[i].ok) an_scan(s.in[i].data, s.in[i].data + s.in[i].len, cv_first, &r);
+		if (r.type) { want_ts = r.has_t; tty_tagged = r.has_src; break; }
+	}
+	ts_anchor.ns = 0; ts_anchor.real_ns = 0;   /* ts_abs() maps e.t back to the logged seconds */
+	struct cv_job j = { &s, csv, arrow, calloc((size_t)s.nt + 1, sizeof(struct cv_out)) };
+	struct pool p;
+	if (!j.out || pool_start(&p, s.nt, jobs, cv_task, &j) < 0) {
+		print_error(1,"out of memory"); free(j.out); an_free(&s);
+		if (arrow) free(aw.rows), free(aw.blk);
+		return 1;
+	}
+	int werr = 0;
+	unsigned long long bad = 0;
+	rc = s.rc;
+	for (int t = 0; t < s.nt; ++t) {
+		pool_wait(&p, t);
+		struct cv_out *o = &j.out[t];
+		if (o->err) { print_error(1,"cannot convert '%s': %s", s.in[s.t[t].in].path, strerror(o->err)); rc = 1; }
+		else if (arrow) ar_add(&aw, o->rows, o->nrows);
+		else if (!werr && o->len && fwrite(o->buf, 1, o->len, fp) != o->len) werr = errno;
+		bad += o->bad;
+		free(o->buf); o->buf = NULL;
+		free(o->rows); o->rows = NULL;
+	}
+	pool_join(&p);
+	if (arrow) werr = ar_close(&aw);
+	if ((fflush(fp) != 0 && !werr) || (fp != stdout && fclose(fp) != 0 && !werr)) werr = errno;
+	if (werr) { print_error(3,"write failed: %s", strerror(werr)); rc = 3; }
+	if (bad) print_warn("skipped %llu unparsed records", bad);
+	free(j.out);
+	an_free(&s);
+	return rc;
+}
+
+/* "mouse-tool merge": one time-ordered stream from many logs. Every input keeps a cursor
+   and its next record, and a binary min-heap over (time, input) picks the one to write,
+   so memory is O(inputs) however long the logs are (files are mapped, not read). Time is
+   "ts", else the running "dt" from the start of each log; "src" is the input's position. */
+#define MG_RELEASE (1u << 20)
+struct mg_src { struct acur c; struct arec r; double t, cum; const char *keep; };   /* keep: first still-mapped byte */
+
+static int mg_less(const struct mg_src *m, int a, int b) { return m[a].t < m[b].t || (m[a].t == m[b].t && a < b); }
+
+static void mg_sift(int *h, int n, int i, const struct mg_src *m)
+{
+	for (;;) {
+		int l = 2 * i + 1, r = l + 1, s = i;
+		if (l < n && mg_less(m, h[l], h[s])) s = l;
+		if (r < n && mg_less(m, h[r], h[s])) s = r;
+		if (s == i) return;
+		int t = h[i]; h[i] = h[s]; h[s] = t; i = s;
+	}
+}
+
+/* move input m to its next well-formed record; returns 0 at its end */
+static int mg_advance(struct mg_src *m, int by_dt, unsigned long long *bad)
+{
+	int k;
+	if (m->keep && (size_t)(m->c.p - m->keep) >= MG_RELEASE) { /* unmap what is merged already */
+		size_t l = (size_t)(m->c.p - m->keep) & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+		munmap((void *)m->keep, l);
+		m->keep += l;
+	}
+	while ((k = an_next(&m->c, &m->r)) == 0) (*bad)++;
+	if (k < 0) return 0;
+	if (m->r.has_dt) m->cum += m->r.dt;
+	m->t = m->r.has_t && !by_dt ? m->r.t : m->cum;
+	return 1;
+}
+
+static int merge_main(int argc, char **argv)
+{
+	int csv = 0, overwrite = 0, rc;
+	const char *out_path = NULL;
+	static struct option mopts[] = {
+		{"to", required_argument, NULL, 't'},
+		{"outfile", required_argument, NULL, 'o'},
+		{"overwrite", no_argument, NULL, 'O'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "t:o:O", mopts, NULL)) != -1) {
+		if (ch == 't') {
+			if (!strcmp(optarg, "csv")) csv = 1;
+			else if (!strcmp(optarg, "jsonl")) csv = 0;
+			else { print_error(2,"--to requires csv or jsonl"); return 2; }
+		}
+		else if (ch == 'o') out_path = optarg;
+		else if (ch == 'O') overwrite = 1;
+		else { print_error(2,"usage: merge [--to jsonl|csv] [-o FILE [-O]] FILE|DIR..."); return 2; }
+	}
+	if (optind >= argc) { print_error(2,"merge needs at least one FILE or DIR (or - for stdin)"); return 2; }
+	FILE *fp = stdout;
+	if (out_path && (rc = an_outfile(out_path, overwrite, &fp))) return rc;
+	struct an_set s; memset(&s, 0, sizeof(s));
+	for (int i = optind; i < argc; ++i) if (an_collect(&s, argv[i], 0) < 0) { print_error(1,"out of memory"); an_free(&s); return 1; }
+	an_load(&s);
+	struct mg_src *m = calloc((size_t)s.nin + 1, sizeof(*m));
+	int *h = calloc((size_t)s.nin + 1, sizeof(*h)), n = 0;
+	char *text = malloc(PASTE_MAX);
+	if (!m || !h || !text) { print_error(1,"out of memory"); free(m); free(h); free(text); an_free(&s); return 1; }
+	unsigned long long bad = 0;
+	want_ts = 1; tty_tagged = 1;
+	for (int i = 0; i < s.nin; ++i) {
+		if (!s.in[i].ok) continue;
+		an_open(&m[i].c, s.in[i].data, s.in[i].data + s.in[i].len);
+		m[i].keep = s.in[i].mapped ? s.in[i].data : NULL;
+		if (!mg_advance(&m[i], 0, &bad)) continue;
+		if (!m[i].r.has_t) {
+			want_ts = 0;
+			if (!m[i].r.has_dt) print_warn("'%s' has no times; its events come first, in file order", s.in[i].path);
+		}
+		h[n++] = i;
+	}
+	if (!want_ts) {
+		print_warn("not every input has \"ts\" (-T); logs are aligned at their start by \"dt\"");
+		for (int i = 0; i < n; ++i) m[h[i]].t = m[h[i]].cum;
+	}
+	for (int i = n / 2 - 1; i >= 0; --i) mg_sift(h, n, i, m);
+	ts_anchor.ns = 0; ts_anchor.real_ns = 0;   /* ts_abs() maps e.t back to the logged seconds */
+	double prev = 0.0;
+	for (int first = 1; n; first = 0) {
+		struct mg_src *top = &m[h[0]];
+		an_emit(fp, csv, &top->r, top->t, h[0], first ? 0.0 : top->t - prev, text);
+		prev = top->t;
+		if (!mg_advance(top, !want_ts, &bad)) h[0] = h[--n];
+		mg_sift(h, n, 0, m);
+	}
+	rc = s.rc;
+	if (fflush(fp) != 0 || ferror(fp) || (fp != stdout && fclose(fp) != 0)) { print_error(3,"write failed: %s", strerror(errno)); rc = 3; }
+	if (bad) print_warn("skipped %llu unparsed records", bad);
+	free(m); free(h); free(text);
+	an_free(&s);
+	return rc;
+}
+
+/* spatio-temporal index ("mouse-tool index FILE" writes FILE.idx): the log is cut in one
+   pass into blocks of at most IX_BLOCK records spanning at most --bucket seconds. Every
+   block keeps its byte range, time range, bounding box, a mask of event types and a bitmap
+   of the coarse cells (an 8x8 grid of cell_w x cell_h, the last row/column open-ended)
+   its mouse events touch, so "mouse-tool query" skips blocks that cannot match without
+   reading them. The sidecar is stamped with the log's size and mtime and ignored when stale. */
+#define IX_MAGIC "MTIDX01\n"
+#define IX_BLOCK 4096
+#define IX_CELL_W 32
+#define IX_CELL_H 16
+struct ix_head { char magic[8]; uint32_t order, nblocks; uint64_t size; int64_t mtime_ns; uint32_t cell_w, cell_h; };
+struct ix_block {
+	uint64_t off, end;        /* record bytes [off, end) of the log */
+	double t0, t1, cum0;      /* time range; cum0 is the running dt before the block */
+	int32_t x0, y0, x1, y1;   /* x0 > x1: no mouse events */
+	uint32_t n, types;
+	uint64_t cells;
+};
+
+static int ix_cell(int v, int size) { v = (v > 0 ? v - 1 : 0) / size; return v > 7 ? 7 : v; }
+
+/* cells of the rectangle [x0, x1] x [y0, y1] */
+static uint64_t ix_cells(int x0, int y0, int x1, int y1, int cw, int chh)
+{
+	uint64_t m = 0;
+	for (int cy = ix_cell(y0, chh); cy <= ix_cell(y1, chh); ++cy)
+		for (int cx = ix_cell(x0, cw); cx <= ix_cell(x1, cw); ++cx) m |= 1ULL << (cy * 8 + cx);
+	return m;
+}
+
+static int64_t ix_mtime(const struct stat *st) { return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec; }
+
+static int ix_build(const char *path, double bucket)
+{
+	const char *data; size_t len; int mapped;
+	struct stat st;
+	if (stat(path, &st) < 0 || an_map(path, &data, &len, &mapped) < 0) { print_error(3,"cannot read '%s': %s", path, strerror(errno)); return 3; }
+	if (!mapped && len) { an_unmap(data, len, mapped); print_error(2,"'%s' is not a regular file", path); return 2; }
+	size_t cap = 256, nb = 0;
+	struct ix_block *b = malloc(cap * sizeof(*b));
+	if (!b) { an_unmap(data, len, mapped); print_error(1,"out of memory"); return 1; }
+	struct acur c; struct arec r; int k;
+	an_open(&c, data, data + len);
+	double cum = 0.0;
+	struct ix_block *cur = NULL;
+	for (const char *at = data; (k = an_next(&c, &r)) >= 0; at = c.p) {
+		double cum_before = cum;
+		if (k && r.has_dt) cum += r.dt;
+		double t = k && r.has_t ? r.t : cum;
+		int timed = k && (r.has_t || r.has_dt);
+		if (!cur || cur->n >= IX_BLOCK || (timed && cur->n && t - cur->t0 > bucket)) {
+			if (cur) cur->end = (uint64_t)(at - data);
+			if (nb == cap) {
+				struct ix_block *nbp = realloc(b, (cap *= 2) * sizeof(*b));
+				if (!nbp) { free(b); an_unmap(data, len, mapped); print_error(1,"out of memory"); return 1; }
+				b = nbp;
+			}
+			cur = &b[nb++];
+			memset(cur, 0, sizeof(*cur));
+			cur->off = (uint64_t)(at - data); cur->cum0 = cum_before;
+			cur->x0 = cur->y0 = INT32_MAX; cur->x1 = cur->y1 = INT32_MIN;
+			cur->t0 = t; cur->t1 = t;
+		}
+		cur->n++;
+		if (!k) continue;
+		cur->types |= 1u << r.type;
+		if (timed) { if (t < cur->t0) cur->t0 = t; if (t > cur->t1) cur->t1 = t; }
+		if (r.has_xy && r.type < EVT_KEY) {
+			if (r.x < cur->x0) cur->x0 = r.x;
+			if (r.x > cur->x1) cur->x1 = r.x;
+			if (r.y < cur->y0) cur->y0 = r.y;
+			if (r.y > cur->y1) cur->y1 = r.y;
+			cur->cells |= 1ULL << (ix_cell(r.y, IX_CELL_H) * 8 + ix_cell(r.x, IX_CELL_W));
+		}
+	}
+	if (cur) cur->end = (uint64_t)len;
+	an_unmap(data, len, mapped);
+	struct ix_head h;
+	memcpy(h.magic, IX_MAGIC, 8);
+	h.order = 0x01020304; h.nblocks = (uint32_t)nb; h.size = (uint64_t)st.st_size; h.mtime_ns = ix_mtime(&st);
+	h.cell_w = IX_CELL_W; h.cell_h = IX_CELL_H;
+	char ip[4096], tmp[4096 + 8];
+	snprintf(ip, sizeof(ip), "%s.idx", path);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", ip);
+	FILE *fp = fopen(tmp, "wb");
+	int ok = fp && fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(b, sizeof(*b), nb, fp) == nb;
+	if (fp && fclose(fp) != 0) ok = 0;
+	free(b);
+	if (!ok || rename(tmp, ip) < 0) { print_error(3,"cannot write '%s': %s", ip, strerror(errno)); unlink(tmp); return 3; }
+	return 0;
+}
+
+/* blocks of path's sidecar when it matches the log (st); NULL otherwise */
+static struct ix_block *ix_load(const char *path, const struct stat *st, struct ix_head *h)
+{
+	char ip[4096];
+	snprintf(ip, sizeof(ip), "%s.idx", path);
+	FILE *fp = fopen(ip, "rb");
+	if (!fp) return NULL;
+	struct ix_block *b = NULL;
+	if (fread(h, sizeof(*h), 1, fp) == 1 && !memcmp(h->magic, IX_MAGIC, 8) && h->order == 0x01020304
+		&& h->size == (uint64_t)st->st_size && h->mtime_ns == ix_mtime(st) && h->cell_w && h->cell_h
+		&& (b = malloc((size_t)h->nblocks * sizeof(*b) + 1)) && fread(b, sizeof(*b), h->nblocks, fp) != h->nblocks) { free(b); b = NULL; }
+	fclose(fp);
+	for (uint32_t i = 0; b && i < h->nblocks; ++i) if (b[i].off > b[i].end || b[i].end > h->size) { free(b); b = NULL; }
+	return b;
+}
+
+static int index_main(int argc, char **argv)
+{
+	double bucket = 1.0;
+	static struct option iopts[] = {
+		{"bucket", required_argument, NULL, 'b'},
+		{0,0,0,0}
+	};
+	int ch, rc = 0;
+	while ((ch = getopt_long(argc, argv, "b:", iopts, NULL)) != -1) {
+		if (ch == 'b') { if (!parse_positive_double(optarg, &bucket)) { print_error(2,"--bucket requires positive seconds"); return 2; } }
+		else { print_error(2,"usage: index [--bucket SEC] FILE..."); return 2; }
+	}
+	if (optind >= argc) { print_error(2,"index needs at least one FILE"); return 2; }
+	for (int i = optind; i < argc; ++i) { int r = ix_build(argv[i], bucket); if (r) rc = r; }
+	return rc;
+}
+
+/* "mouse-tool query": print the records of FILE... that match, as they are in the log */
+static int query_main(int argc, char **argv)
+{
+	struct afilter f; memset(&f, 0, sizeof(f));
+	unsigned types = 0;
+	int count_only = 0, rc = 0;
+	unsigned long long hits = 0;
+	static struct option qopts[] = {
+		{"from", required_argument, NULL, 'f'},
+		{"to", required_argument, NULL, 't'},
+		{"region", required_argument, NULL, 'r'},
+		{"type", required_argument, NULL, 'y'},
+		{"count", no_argument, NULL, 'c'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "f:t:r:y:c", qopts, NULL)) != -1) {
+		char *end;
+		if (ch == 'f' || ch == 't') {
+			errno = 0; double v = strtod(optarg, &end);
+			if (errno || end == optarg || *end) { print_error(2,"--from/--to require seconds"); return 2; }
+			if (ch == 'f') { f.from = v; f.have_from = 1; } else { f.to = v; f.have_to = 1; }
+		}
+		else if (ch == 'r') {
+			if (sscanf(optarg, "%d,%d,%d,%d", &f.x0, &f.y0, &f.x1, &f.y1) != 4 || f.x0 > f.x1 || f.y0 > f.y1) { print_error(2,"--region requires X0,Y0,X1,Y1"); return 2; }
+			f.region = 1;
+		}
+		else if (ch == 'y') {
+			for (char *s = optarg; *s;) {
+				size_t n = strcspn(s, ",");
+				int t = an_type(s, n);
+				if (!t) { print_error(2,"--type takes press,release,motion,scroll,key,focus,paste,dwell"); return 2; }
+				types |= 1u << t;
+				s += n + (s[n] == ',');
+			}
+		}
+		else if (ch == 'c') count_only = 1;
+		else { print_error(2,"usage: query [--from SEC] [--to SEC] [--region X0,Y0,X1,Y1] [--type LIST] [--count] FILE..."); return 2; }
+	}
+	if (optind >= argc) { print_error(2,"query needs at least one FILE"); return 2; }
+	for (int i = optind; i < argc; ++i) {
+		const char *path = argv[i], *data; size_t len; int mapped;
+		struct stat st;
+		if (stat(path, &st) < 0 || an_map(path, &data, &len, &mapped) < 0) { print_error(3,"cannot read '%s': %s", path, strerror(errno)); rc = 3; continue; }
+		struct ix_head h;
+		struct ix_block *b = ix_load(path, &st, &h), whole;
+		uint32_t nb = b ? h.nblocks : 1;
+		if (!b) {
+			print_warn("no up-to-date index for '%s' (run \"mouse-tool index\"); scanning it", path);
+			memset(&whole, 0, sizeof(whole)); whole.end = len;
+		}
+		uint64_t qcells = f.region && b ? ix_cells(f.x0, f.y0, f.x1, f.y1, (int)h.cell_w, (int)h.cell_h) : 0;
+		const char *p = data, *e = data + len;
+		while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+		int json = p < e && *p == '{';
+		for (uint32_t k = 0; k < nb; ++k) {
+			const struct ix_block *blk = b ? &b[k] : &whole;
+			if (b) {
+				if (types && !(blk->types & types)) continue;
+				if (f.have_from && blk->t1 < f.from) continue;
+				if (f.have_to && blk->t0 > f.to) continue;
+				if (f.region && (blk->x0 > blk->x1 || blk->x1 < f.x0 || blk->x0 > f.x1 || blk->y1 < f.y0 || blk->y0 > f.y1 || !(blk->cells & qcells))) continue;
+			}
+			struct acur c = { data + blk->off, data + blk->end, json, NULL, NULL };
+			struct arec r; int ok;
+			double cum = blk->cum0;
+			while ((ok = an_next(&c, &r)) >= 0) {
+				if (!ok) continue;
+				if (r.has_dt) cum += r.dt;
+				if (!r.has_t && r.has_dt) { r.t = cum; r.has_t = 1; }
+				if (types && !(types & (1u << r.type))) continue;
+				if ((f.have_from || f.have_to) && (!r.has_t || (f.have_from && r.t < f.from) || (f.have_to && r.t > f.to))) continue;
+				if (f.region && (!r.has_xy || r.type >= EVT_KEY || r.x < f.x0 || r.x > f.x1 || r.y < f.y0 || r.y > f.y1)) continue;
+				hits++;
+				if (!count_only) { fwrite(c.rec, 1, (size_t)(c.rec_end - c.rec), stdout); putchar('\n'); }
+			}
+		}
+		free(b);
+		an_unmap(data, len, mapped);
+	}
+	if (count_only) printf("%llu\n", hits);
+	if (fflush(stdout) != 0) { print_error(3,"write failed: %s", strerror(errno)); rc = 3; }
+	return rc;
+}
+
+/* time-tiered compaction ("mouse-tool compact FILE", JSON logs). Relative to the newest
+   event, records younger than --full stay as they are; older motion is simplified
+   (Ramer-Douglas-Peucker over every run of motion, --epsilon cells) and motion older than
+   --coarse becomes heatmap tiles: one motion record per button, touched --cell and --tile
+   window. A motion record's "count" is the number of events it stands for. Other records are always kept,
+   and dt is rewritten so the time axis is unchanged. Only what follows the tile section
+   is rewritten (its end is kept in FILE.compact), so repeated runs over an append-only
+   archive cost its recent part. The new tail is staged in FILE.compact.tmp first, and a
+   run that was interrupted while swapping it in is finished by the next one. */
+#define CP_MAGIC "MTCMP01\n"
+struct cp_state {
+	char magic[8];
+	uint32_t order, pending;
+	uint64_t tail, size;   /* pending: FILE.compact.tmp goes at tail, giving size */
+	uint64_t stable;       /* end of the tile section */
+	double cum, t_prev;    /* running dt and time of the last record before stable */
+};
+struct cp_pt { struct arec r; double t; };
+struct cp_tile { uint64_t key; unsigned long long n; };
+struct cp {
+	FILE *fp;
+	double eps, tile; int cw, chh;
+	int have_last; double last;   /* time of the last record written */
+	struct cp_pt *run; size_t nrun, caprun;
+	size_t *stack; unsigned char *keep;
+	struct cp_tile *tiles; size_t ntiles, captiles;   /* open addressing, key 0 unused */
+	double win, win_t; int have_win;
+	int err;
+};
+
+static void cp_put(struct cp *c, const struct arec *r, double t, char *text)
+{
+	an_emit(c->fp, 0, r, t, r->src, c->have_last ? t - c->last : r->has_dt ? r->dt : 0.0, text);
+	c->last = t; c->have_last = 1;
+}
+
+/* a motion record standing for count events */
+static void cp_motion(struct cp *c, int x, int y, int button, int mods, unsigned long long count, int src, double t)
+{
+	fprintf(c->fp, "{\"x\":%d,\"y\":%d,\"button\":%d,\"mods\":%d,\"type\":\"motion\",\"count\":%llu", x, y, button, mods, count);
+	if (tty_tagged) fprintf(c->fp, ",\"src\":%d", src);
+	if (want_ts) fprintf(c->fp, ",\"ts\":%.6f", t);
+	fprintf(c->fp, ",\"dt\":%.6f}\n", c->have_last ? t - c->last : 0.0);
+	c->last = t; c->have_last = 1;
+}
+
+static int cp_tile_cmp(const void *a, const void *b)
+{
+	uint64_t x = ((const struct cp_tile *)a)->key, y = ((const struct cp_tile *)b)->key;
+	return x < y ? -1 : x > y;
+}
+
+static void cp_tiles_flush(struct cp *c)
+{
+	if (!c->have_win) return;
+	size_t n = 0;
+	for (size_t i = 0; i < c->captiles; ++i) if (c->tiles[i].key) c->tiles[n++] = c->tiles[i];
+	qsort(c->tiles, n, sizeof(*c->tiles), cp_tile_cmp);
+	double t = c->have_last && c->last > c->win_t ? c->last : c->win_t;
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t k = c->tiles[i].key;
+		int src = (int)(k >> 44), button = (int)((k >> 40) & 15), cy = (int)((k >> 20) & 0xfffff) - 1, cx = (int)(k & 0xfffff);
+		cp_motion(c, cx * c->cw + (c->cw + 1) / 2, cy * c->chh + (c->chh + 1) / 2, button, 0, c->tiles[i].n, src, t);
+	}
+	memset(c->tiles, 0, c->captiles * sizeof(*c->tiles));
+	c->ntiles = 0; c->have_win = 0;
+}
+
+static void cp_tile_add(struct cp *c, const struct arec *r, double t)
+{
+	double w = (double)(long long)(t / c->tile);
+	if (c->have_win && w != c->win) cp_tiles_flush(c);
+	if (c->ntiles * 2 >= c->captiles) {   /* grow and rehash */
+		size_t cap = c->captiles ? c->captiles * 2 : 256;
+		struct cp_tile *nt = calloc(cap, sizeof(*nt));
+		if (!nt) { c->err = ENOMEM; return; }
+		for (size_t i = 0; i < c->captiles; ++i) if (c->tiles[i].key) {
+			size_t j = (size_t)(c->tiles[i].key * 0x9E3779B97F4A7C15ULL) & (cap - 1);
+			while (nt[j].key) j = (j + 1) & (cap - 1);
+			nt[j] = c->tiles[i];
+		}
+		free(c->tiles); c->tiles = nt; c->captiles = cap;
+	}
+	int cx = r->x > 0 ? (r->x - 1) / c->cw : 0, cy = r->y > 0 ? (r->y - 1) / c->chh : 0;
+	/* one tile per source, button (3: none, 0-2: drag) and cell */
+	uint64_t key = ((uint64_t)(r->src & 0xfffff) << 44) | ((uint64_t)(r->button & 15) << 40) | ((uint64_t)(cy + 1) << 20) | (uint64_t)(cx & 0xfffff);
+	size_t j = (size_t)(key * 0x9E3779B97F4A7C15ULL) & (c->captiles - 1);
+	while (c->tiles[j].key && c->tiles[j].key != key) j = (j + 1) & (c->captiles - 1);
+	if (!c->tiles[j].key) { c->tiles[j].key = key; c->ntiles++; }
+	c->tiles[j].n += r->count ? r->count : 1;
+	c->win = w; c->win_t = t; c->have_win = 1;
+}
+
+/* squared distance of p from the line through a and b (from a when a == b) */
+static double cp_dist2(const struct cp_pt *p, const struct cp_pt *a, const struct cp_pt *b)
+{
+	double dx = b->r.x - a->r.x, dy = b->r.y - a->r.y, px = p->r.x - a->r.x, py = p->r.y - a->r.y;
+	double l2 = dx * dx + dy * dy, cr = dx * py - dy * px;
+	return l2 == 0.0 ? px * px + py * py : cr * cr / l2;
+}
+
+static void cp_run_flush(struct cp *c, char *text)
+{
+	size_t n = c->nrun;
+	if (!n) return;
+	memset(c->keep, 0, n);
+	c->keep[0] = c->keep[n - 1] = 1;
+	size_t sp = 0;
+	if (n > 2) { c->stack[sp++] = 0; c->stack[sp++] = n - 1; }
+	while (sp) {
+		size_t b = c->stack[--sp], a = c->stack[--sp], at = 0;
+		double dmax = 0.0;
+		for (size_t i = a + 1; i < b; ++i) { double d = cp_dist2(&c->run[i], &c->run[a], &c->run[b]); if (d > dmax) { dmax = d; at = i; } }
+		if (dmax > c->eps * c->eps) {
+			c->keep[at] = 1;
+			if (at - a > 1) { c->stack[sp++] = a; c->stack[sp++] = at; }
+			if (b - at > 1) { c->stack[sp++] = at; c->stack[sp++] = b; }
+		}
+	}
+	unsigned long long w = 0;   /* dropped points are counted by the next one kept */
+	for (size_t i = 0; i < n; ++i) {
+		const struct arec *r = &c->run[i].r;
+		w += r->count ? r->count : 1;
+		if (!c->keep[i]) continue;
+		if (w > 1) cp_motion(c, r->x, r->y, r->button, r->mods, w, r->src, c->run[i].t);
+		else cp_put(c, r, c->run[i].t, text);
+		w = 0;
+	}
+	c->nrun = 0;
+}
+
+static void cp_run_add(struct cp *c, const struct arec *r, double t)
+{
+	if (c->nrun == c->caprun) {
+		size_t cap = c->caprun ? c->caprun * 2 : 1024;
+		struct cp_pt *nr = realloc(c->run, cap * sizeof(*nr));
+		size_t *ns = nr ? realloc(c->stack, 2 * cap * sizeof(*ns)) : NULL;
+		unsigned char *nk = ns ? realloc(c->keep, cap) : NULL;
+		if (nr) c->run = nr;
+		if (ns) c->stack = ns;
+		if (!nk) { c->err = ENOMEM; return; }
+		c->keep = nk; c->caprun = cap;
+	}
+	c->run[c->nrun].r = *r; c->run[c->nrun].t = t; c->nrun++;
+}
+
+static int cp_state_write(const char *sp, const struct cp_state *st)
+{
+	char tmp[4096 + 8];
+	snprintf(tmp, sizeof(tmp), "%s.new", sp);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return -1;
+	int ok = write(fd, st, sizeof(*st)) == (ssize_t)sizeof(*st) && fsync(fd) == 0;
+	if (close(fd) != 0) ok = 0;
+	if (!ok || rename(tmp, sp) < 0) { unlink(tmp); return -1; }
+	return 0;
+}
+
+/* put the staged tail in place: truncate the log at tail and append FILE.compact.tmp */
+static int cp_swap(const char *path, const char *tp, const struct cp_state *st)
+{
+	int in = open(tp, O_RDONLY | O_CLOEXEC);
+	if (in < 0) return -1;
+	int out = open(path, O_WRONLY | O_CLOEXEC);
+	int ok = out >= 0 && ftruncate(out, (off_t)st->tail) == 0 && lseek(out, (off_t)st->tail, SEEK_SET) >= 0;
+	char buf[1 << 16]; ssize_t n;
+	while (ok && (n = read(in, buf, sizeof(buf))) != 0) {
+		if (n < 0) { if (errno == EINTR) continue; ok = 0; break; }
+		for (ssize_t o = 0; ok && o < n;) { ssize_t w = write(out, buf + o, (size_t)(n - o)); if (w < 0 && errno != EINTR) ok = 0; else if (w > 0) o += w; }
+	}
+	if (ok && fsync(out) != 0) ok = 0;
+	int er = errno;
+	close(in);
+	if (out >= 0) close(out);
+	if (!ok) { errno = er; return -1; }
+	unlink(tp);
+	return 0;
+}
+
+static int cp_compact(const char *path, double full, double coarse, double tile, int cw, int chh, double eps)
+{
+	char sp[4096], tp[4096 + 8];
+	snprintf(sp, sizeof(sp), "%s.compact", path);
+	snprintf(tp, sizeof(tp), "%s.tmp", sp);
+	struct cp_state st; memset(&st, 0, sizeof(st));
+	int fd = open(sp, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		if (read(fd, &st, sizeof(st)) != (ssize_t)sizeof(st) || memcmp(st.magic, CP_MAGIC, 8) || st.order != 0x01020304) memset(&st, 0, sizeof(st));
+		close(fd);
+	}
+	struct stat fs;
+	if (st.pending) {   /* an earlier run stopped while swapping its tail in */
+		struct stat ts;
+		if (stat(tp, &ts) == 0 && (uint64_t)ts.st_size == st.size - st.tail) {
+			if (cp_swap(path, tp, &st) < 0) { print_error(3,"cannot finish the interrupted compaction of '%s': %s", path, strerror(errno)); return 3; }
+		} else if (stat(path, &fs) < 0 || (uint64_t)fs.st_size < st.size) memset(&st, 0, sizeof(st));
+		st.pending = 0;
+		unlink(tp);
+		if (st.stable && cp_state_write(sp, &st) < 0) { print_error(3,"cannot write '%s': %s", sp, strerror(errno)); return 3; }
+	}
+	const char *data; size_t len; int mapped;
+	if (an_map(path, &data, &len, &mapped) < 0) { print_error(3,"cannot read '%s': %s", path, strerror(errno)); return 3; }
+	if (!mapped && len) { an_unmap(data, len, mapped); print_error(2,"'%s' is not a regular file", path); return 2; }
+	if (!st.stable || st.stable > len || len < st.size) { memset(&st, 0, sizeof(st)); }
+	struct acur cur; struct arec r; int k;
+	an_open(&cur, data + st.stable, data + len);
+	if (cur.p < cur.e && !cur.json) { an_unmap(data, len, mapped); print_error(2,"'%s': only JSON logs can be compacted (CSV has no motion)", path); return 2; }
+	/* pass 1: the newest time, and the output columns */
+	double cum = st.cum, newest = st.t_prev;
+	int first = 1;
+	want_ts = 0; tty_tagged = 0;
+	while ((k = an_next(&cur, &r)) >= 0) {
+		if (!k) continue;
+		if (first) { want_ts = r.has_t; tty_tagged = r.has_src; first = 0; }
+		if (r.has_dt) cum += r.dt;
+		newest = r.has_t ? r.t : cum;
+	}
+	if (first) { an_unmap(data, len, mapped); return 0; }   /* nothing after the tile section */
+	ts_anchor.ns = 0; ts_anchor.real_ns = 0;   /* ts_abs() maps e.t back to the logged seconds */
+	struct cp c; memset(&c, 0, sizeof(c));
+	c.eps = eps; c.tile = tile; c.cw = cw; c.chh = chh;
+	c.have_last = st.stable > 0; c.last = st.t_prev;
+	char *text = malloc(PASTE_MAX);
+	if (!text || !(c.fp = fopen(tp, "w"))) { int er = text ? errno : ENOMEM; free(text); an_unmap(data, len, mapped); print_error(3,"cannot write '%s': %s", tp, strerror(er)); return 3; }
+	/* pass 2: tiles, simplified runs, then the rest as it is */
+	struct cp_state ns = st;
+	int tier = 0;   /* 0 tiles, 1 simplified, 2 full */
+	double prev_in = st.t_prev; int have_prev_in = st.stable > 0;
+	unsigned long long bad = 0;
+	long stable_out = 0;
+	cum = st.cum;
+	an_open(&cur, data + st.stable, data + len);
+	while (!c.err && (k = an_next(&cur, &r)) >= 0) {
+		if (!k) { bad++; continue; }
+		if (r.has_dt) cum += r.dt;
+		double t = r.has_t ? r.t : cum, age = newest - t;
+		int want = age >= coarse ? 0 : age >= full ? 1 : 2;
+		if (want > tier) {
+			if (tier == 0) {
+				cp_tiles_flush(&c);
+				stable_out = ftell(c.fp);
+				ns.cum = ns.t_prev = c.last;   /* what follows has its dt from here */
+			}
+			if (want == 2) cp_run_flush(&c, text);
+			tier = want;
+		}
+		if (tier == 0) {
+			if (r.type == EVT_MOTION) cp_tile_add(&c, &r, t);
+			else cp_put(&c, &r, t, text);
+		} else if (tier == 1) {
+			if (r.type == EVT_MOTION) cp_run_add(&c, &r, t);
+			else { cp_run_flush(&c, text); cp_put(&c, &r, t, text); }
+		} else if (c.have_last && have_prev_in && c.last != prev_in) cp_put(&c, &r, t, text);   /* dt spans dropped records */
+		else {
+			fwrite(cur.rec, 1, (size_t)(cur.rec_end - cur.rec), c.fp); fputc('\n', c.fp);
+			c.last = t; c.have_last = 1;
+		}
+		prev_in = t; have_prev_in = 1;
+	}
+	if (tier == 0) { cp_tiles_flush(&c); stable_out = ftell(c.fp); ns.cum = ns.t_prev = c.last; }
+	cp_run_flush(&c, text);
+	free(text); free(c.run); free(c.stack); free(c.keep); free(c.tiles);
+	int ok = !c.err && fflush(c.fp) == 0 && fsync(fileno(c.fp)) == 0;
+	long out_len = ftell(c.fp);
+	if (fclose(c.fp) != 0) ok = 0;
+	an_unmap(data, len, mapped);
+	if (!ok || out_len < 0 || stable_out < 0) { print_error(3,"cannot write '%s': %s", tp, strerror(c.err ? c.err : errno)); unlink(tp); return 3; }
+	memcpy(ns.magic, CP_MAGIC, 8); ns.order = 0x01020304;
+	ns.pending = 1; ns.tail = st.stable; ns.size = st.stable + (uint64_t)out_len;
+	ns.stable = st.stable + (uint64_t)stable_out;
+	if (cp_state_write(sp, &ns) < 0 || cp_swap(path, tp, &ns) < 0) { print_error(3,"cannot compact '%s': %s (rerun to finish)", path, strerror(errno)); return 3; }
+	ns.pending = 0;
+	if (cp_state_write(sp, &ns) < 0) { print_error(3,"cannot write '%s': %s", sp, strerror(errno)); return 3; }
+	if (bad) print_warn("'%s': dropped %llu unparsed records", path, bad);
+	return 0;
+}
+
+static int compact_main(int argc, char **argv)
+{
+	double full = 86400.0, coarse = 604800.0, tile = 60.0, eps = 1.0;
+	int cw = 8, chh = 4, rc = 0;
+	static struct option kopts[] = {
+		{"full", required_argument, NULL, 'f'},
+		{"coarse", required_argument, NULL, 'c'},
+		{"tile", required_argument, NULL, 't'},
+		{"cell", required_argument, NULL, 'C'},
+		{"epsilon", required_argument, NULL, 'e'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "f:c:t:C:e:", kopts, NULL)) != -1) {
+		if (ch == 'f') { if (!parse_positive_double(optarg, &full)) { print_error(2,"--full requires positive seconds"); return 2; } }
+		else if (ch == 'c') { if (!parse_positive_double(optarg, &coarse)) { print_error(2,"--coarse requires positive seconds"); return 2; } }
+		else if (ch == 't') { if (!parse_positive_double(optarg, &tile)) { print_error(2,"--tile requires positive seconds"); return 2; } }
+		else if (ch == 'e') { if (!parse_positive_double(optarg, &eps)) { print_error(2,"--epsilon requires positive cells"); return 2; } }
+		else if (ch == 'C') { if (sscanf(optarg, "%dx%d", &cw, &chh) != 2 || cw < 1 || chh < 1 || cw > 4096 || chh > 4096) { print_error(2,"--cell requires WxH"); return 2; } }
+		else { print_error(2,"usage: compact [--full SEC] [--coarse SEC] [--tile SEC] [--cell WxH] [--epsilon CELLS] FILE..."); return 2; }
+	}
+	if (coarse < full) { print_error(2,"--coarse must not be shorter than --full"); return 2; }
+	if (optind >= argc) { print_error(2,"compact needs at least one FILE"); return 2; }
+	for (int i = optind; i < argc; ++i) { int r = cp_compact(argv[i], full, coarse, tile, cw, chh, eps); if (r) rc = r; }
+	return rc;
+}
+
+/* "mouse-tool compare GOLDEN FRESH": press/release sequences must match exactly (type,
+   button, position); motion paths (every positioned mouse event) are aligned by dynamic
+   time warping inside a Sakoe-Chiba band of --band points around the scaled diagonal,
+   with the L1 distance in cells as the local cost. A golden point with no fresh point
+   within --threshold cells in its band is where the paths diverge. Each DTW row is
+   computed 4 lanes at a time with vector extensions (cost, and the best of the up and
+   diagonal cells); only the dependency on the left neighbour remains a scalar pass. */
+typedef float cmp_vf __attribute__((vector_size(16)));
+typedef int cmp_vi __attribute__((vector_size(16)));
+#define CMP_LANES 4
+
+struct cmp_seq {
+	float *x, *y; double *t; size_t n, cap;   /* motion path */
+	struct cmp_click { int type, button, x, y; double t; } *c; size_t nc, capc;
+};
+
+static int cmp_load(const char *path, struct cmp_seq *s)
+{
+	const char *data; size_t len; int mapped;
+	if (an_map(path, &data, &len, &mapped) < 0) { print_error(3,"cannot read '%s': %s", path, strerror(errno)); return 3; }
+	struct acur c; struct arec r; int k;
+	double cum = 0.0;
+	an_open(&c, data, data + len);
+	while ((k = an_next(&c, &r)) >= 0) {
+		if (!k) continue;
+		if (r.has_dt) cum += r.dt;
+		double t = r.has_t ? r.t : cum;
+		if (!r.has_xy || r.type >= EVT_KEY) continue;
+		if (s->n == s->cap) {
+			size_t cap = s->cap ? s->cap * 2 : 4096;
+			float *nx = realloc(s->x, cap * sizeof(float)), *ny = nx ? realloc(s->y, cap * sizeof(float)) : NULL;
+			double *nt = ny ? realloc(s->t, cap * sizeof(double)) : NULL;
+			if (nx) s->x = nx;
+			if (ny) s->y = ny;
+			if (!nt) { an_unmap(data, len, mapped); print_error(1,"out of memory"); return 1; }
+			s->t = nt; s->cap = cap;
+		}
+		s->x[s->n] = (float)r.x; s->y[s->n] = (float)r.y; s->t[s->n] = t; s->n++;
+		if (r.type != EVT_PRESS && r.type != EVT_RELEASE) continue;
+		if (s->nc == s->capc) {
+			size_t cap = s->capc ? s->capc * 2 : 256;
+			struct cmp_click *nc = realloc(s->c, cap * sizeof(*nc));
+			if (!nc) { an_unmap(data, len, mapped); print_error(1,"out of memory"); return 1; }
+			s->c = nc; s->capc = cap;
+		}
+		s->c[s->nc++] = (struct cmp_click){ r.type, r.button, r.x, r.y, t };
+	}
+	an_unmap(data, len, mapped);
+	return 0;
+}
+
+static cmp_vf cmp_vmin(cmp_vf a, cmp_vf b)
+{
+	cmp_vi m = (cmp_vi)(a < b);
+	return (cmp_vf)(((cmp_vi)a & m) | ((cmp_vi)b & ~m));
+}
+
+static cmp_vf cmp_vabs(cmp_vf a) { return (cmp_vf)((cmp_vi)a & 0x7fffffff); }
+
+/* band of row i: [*lo, *hi] of b's points */
+static void cmp_band(size_t i, size_t n, size_t m, size_t band, size_t *lo, size_t *hi)
+{
+	size_t c = n > 1 ? (size_t)((double)i * (double)(m - 1) / (double)(n - 1) + 0.5) : 0;
+	*lo = c > band ? c - band : 0;
+	*hi = c + band < m - 1 ? c + band : m - 1;
+}
+
+/* banded DTW of a against b; *div is the first point of a farther than thr from every
+   point of b in its band ((size_t)-1 if none), *div_d that distance */
+static double cmp_dtw(const struct cmp_seq *a, const struct cmp_seq *b, size_t band, float thr, size_t *div, float *div_d)
+{
+	size_t n = a->n, m = b->n;
+	float *prev = malloc((m + 1 + CMP_LANES) * sizeof(float)), *cur = malloc((m + 1 + CMP_LANES) * sizeof(float));
+	float *cost = malloc((m + CMP_LANES) * sizeof(float));
+	if (!prev || !cur || !cost) { free(prev); free(cur); free(cost); return -1.0; }
+	const float inf = 1e30f;
+	for (size_t j = 0; j <= m; ++j) prev[j] = inf;
+	prev[0] = 0.0f;   /* D(-1, -1): the path starts at (0, 0) */
+	*div = (size_t)-1; *div_d = 0.0f;
+	size_t lo, hi, nlo, nhi;
+	cmp_band(0, n, m, band, &lo, &hi);
+	const cmp_vf zero = { 0 };
+	for (size_t i = 0; i < n; ++i) {
+		cmp_vf ax = zero + a->x[i], ay = zero + a->y[i], vbest = zero + inf;
+		float best = inf;
+		size_t j = lo;
+		/* cost and min(up, diagonal) for the whole band, 4 lanes at a time */
+		for (; j + CMP_LANES <= hi + 1; j += CMP_LANES) {
+			cmp_vf bx, by, up, dg;
+			memcpy(&bx, b->x + j, sizeof(bx)); memcpy(&by, b->y + j, sizeof(by));
+			memcpy(&up, prev + j + 1, sizeof(up)); memcpy(&dg, prev + j, sizeof(dg));
+			cmp_vf d = cmp_vabs(ax - bx) + cmp_vabs(ay - by);
+			vbest = cmp_vmin(vbest, d);
+			cmp_vf v = cmp_vmin(up, dg) + d;
+			memcpy(cost + j, &d, sizeof(d));
+			memcpy(cur + j + 1, &v, sizeof(v));
+		}
+		for (int l = 0; l < CMP_LANES; ++l) if (vbest[l] < best) best = vbest[l];
+		for (; j <= hi; ++j) {
+			float d = (a->x[i] > b->x[j] ? a->x[i] - b->x[j] : b->x[j] - a->x[i]) + (a->y[i] > b->y[j] ? a->y[i] - b->y[j] : b->y[j] - a->y[i]);
+			float u = prev[j + 1] < prev[j] ? prev[j + 1] : prev[j];
+			cost[j] = d; cur[j + 1] = u + d;
+			if (d < best) best = d;
+		}
+		/* the left neighbour: a scalar pass over the band */
+		cur[lo] = inf;
+		for (j = lo; j <= hi; ++j) { float l = cur[j] + cost[j]; if (l < cur[j + 1]) cur[j + 1] = l; }
+		if (best > thr && *div == (size_t)-1) { *div = i; *div_d = best; }
+		if (i + 1 < n) {
+			cmp_band(i + 1, n, m, band, &nlo, &nhi);
+			for (j = hi + 2; j <= nhi + 1; ++j) cur[j] = inf;
+			lo = nlo < lo ? lo : nlo; hi = nhi;
+		}
+		float *t = prev; prev = cur; cur = t;
+	}
+	double r = prev[m];
+	free(prev); free(cur); free(cost);
+	return r;
+}
+
+static int compare_main(int argc, char **argv)
+{
+	long band = 100; double thr = 2.0;
+	int json = 0;
+	static struct option popts[] = {
+		{"band", required_argument, NULL, 'b'},
+		{"threshold", required_argument, NULL, 't'},
+		{"json", no_argument, NULL, 'j'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "b:t:j", popts, NULL)) != -1) {
+		if (ch == 'b') { if (!parse_positive_int(optarg, &band)) { print_error(2,"--band requires a positive number of points"); return 2; } }
+		else if (ch == 't') { if (!parse_positive_double(optarg, &thr)) { print_error(2,"--threshold requires positive cells"); return 2; } }
+		else if (ch == 'j') json = 1;
+		else { print_error(2,"usage: compare [--band N] [--threshold CELLS] [--json] GOLDEN FRESH"); return 2; }
+	}
+	if (argc - optind != 2) { print_error(2,"compare needs exactly two files: GOLDEN FRESH"); return 2; }
+	struct cmp_seq g, f; memset(&g, 0, sizeof(g)); memset(&f, 0, sizeof(f));
+	int rc = cmp_load(argv[optind], &g);
+	if (!rc) rc = cmp_load(argv[optind + 1], &f);
+	if (rc) goto out;
+	/* press/release: exact, in order */
+	size_t nc = g.nc < f.nc ? g.nc : f.nc, cd = 0;
+	while (cd < nc && g.c[cd].type == f.c[cd].type && g.c[cd].button == f.c[cd].button && g.c[cd].x == f.c[cd].x && g.c[cd].y == f.c[cd].y) cd++;
+	int clicks_ok = cd == g.nc && cd == f.nc;
+	/* motion: banded DTW */
+	double dist = 0.0; size_t div = (size_t)-1; float div_d = 0.0f;
+	if (g.n && f.n) {
+		size_t step = g.n > 1 ? (f.n - 1) / (g.n - 1) + 1 : f.n;   /* consecutive bands must overlap */
+		if ((size_t)band < step) band = (long)step;
+		dist = cmp_dtw(&g, &f, (size_t)band, (float)thr, &div, &div_d);
+		if (dist < 0) { print_error(1,"out of memory"); rc = 1; goto out; }
+	} else if (g.n != f.n) div = 0;
+	double mean = g.n + f.n ? dist / (double)(g.n + f.n) : 0.0;
+	if (json) {
+		printf("{\"golden\":{\"points\":%zu,\"clicks\":%zu},\"fresh\":{\"points\":%zu,\"clicks\":%zu},\"band\":%ld,\"dtw\":%.3f,\"mean\":%.4f", g.n, g.nc, f.n, f.nc, band, dist, mean);
+		if (clicks_ok) printf(",\"clicks_match\":true");
+		else {
+			printf(",\"clicks_match\":false,\"click_divergence\":{\"index\":%zu", cd);
+			if (cd < g.nc) printf(",\"golden\":{\"type\":\"%s\",\"button\":%d,\"x\":%d,\"y\":%d,\"t\":%.6f}", type_str((evtype_t)g.c[cd].type), g.c[cd].button, g.c[cd].x, g.c[cd].y, g.c[cd].t);
+			if (cd < f.nc) printf(",\"fresh\":{\"type\":\"%s\",\"button\":%d,\"x\":%d,\"y\":%d,\"t\":%.6f}", type_str((evtype_t)f.c[cd].type), f.c[cd].button, f.c[cd].x, f.c[cd].y, f.c[cd].t);
+			printf("}");
+		}
+		if (div != (size_t)-1 && div < g.n) printf(",\"path_divergence\":{\"index\":%zu,\"x\":%d,\"y\":%d,\"t\":%.6f,\"distance\":%.1f}", div, (int)g.x[div], (int)g.y[div], g.t[div], div_d);
+		printf("}\n");
+	} else {
+		printf("points    golden %zu, fresh %zu (band %ld)\ndtw       %.3f cells (mean %.4f per point)\n", g.n, f.n, band, dist, mean);
+		if (clicks_ok) printf("clicks    %zu press/release events match\n", g.nc);
+		else {
+			printf("clicks    differ at #%zu:", cd);
+			if (cd < g.nc) printf(" golden %s b%d at %d,%d (t %.6f)", type_str((evtype_t)g.c[cd].type), g.c[cd].button, g.c[cd].x, g.c[cd].y, g.c[cd].t); else printf(" golden ends");
+			if (cd < f.nc) printf(", fresh %s b%d at %d,%d (t %.6f)\n", type_str((evtype_t)f.c[cd].type), f.c[cd].button, f.c[cd].x, f.c[cd].y, f.c[cd].t); else printf(", fresh ends\n");
+		}
+		if (div != (size_t)-1 && div < g.n) printf("path      diverges at golden point #%zu %d,%d (t %.6f): nearest fresh point %.1f cells away\n", div, (int)g.x[div], (int)g.y[div], g.t[div], div_d);
+		else if (div != (size_t)-1) printf("path      one side has no motion\n");
+		else printf("path      within %.1f cells everywhere\n", thr);
+	}
+	rc = clicks_ok && div == (size_t)-1 ? 0 : 1;
+out:
+	free(g.x); free(g.y); free(g.t); free(g.c);
+	free(f.x); free(f.y); free(f.t); free(f.c);
+	return rc;
+}
+
+/* sqrt and log2 without libm (the build links nothing but libc) */
+static double m_sqrt(double v)
+{
+	if (v <= 0.0) return 0.0;
+	double x = v > 1.0 ? v : 1.0;
+	for (int i = 0; i < 64; ++i) x = 0.5 * (x + v / x);
+	return x;
+}
+
+static double m_log2(double v)
+{
+	int e = 0;
+	if (v <= 0.0) return 0.0;
+	while (v >= 2.0) { v *= 0.5; e++; }
+	while (v < 1.0) { v *= 2.0; e--; }
+	double z = (v - 1.0) / (v + 1.0), z2 = z * z, s = 0.0, p = z;   /* ln v = 2 atanh z */
+	for (int k = 1; k < 40; k += 2) { s += p / k; p *= z2; }
+	return e + 2.0 * s / 0.69314718055994530942;
+}
+
+/* Fitts'-law metrics ("mouse-tool metrics --regions FILE LOG"): one pass over the log
+   cuts it into movements, each from the previous release (or the first position) to the
+   next press. A press inside a region (the smallest one, found through a uniform grid
+   of MT_GRID_W x MT_GRID_H cells) is a hit on it; a press outside every region is an
+   error charged to the nearest one. Per movement: D from the start to the target center
+   and W the target's extent along that direction (rows are scaled by --aspect), ID =
+   log2(D/W + 1), MT, overshoot past the press point along the movement axis, and how
+   often the pointer re-entered the target. Throughput comes from the least-squares fit
+   MT = a + b ID over all hits (1/b). Presses that start inside their own target
+   (double clicks, drags) are not movements. */
+#define MT_GRID_W 16
+#define MT_GRID_H 8
+struct mt_region {
+	char name[64]; int x0, y0, x1, y1;
+	unsigned long long hits, misses, reentries;
+	double id_sum, mt_sum, over_sum;
+};
+struct mt_map {
+	struct mt_region *r; int n;
+	int gw, gh; int *start, *list;   /* grid cell g lists regions list[start[g] .. start[g+1]) */
+};
+
+static long mt_area(const struct mt_region *r) { return (long)(r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1); }
+
+static int mt_load(const char *path, struct mt_map *m)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) { print_error(3,"cannot read '%s': %s", path, strerror(errno)); return 3; }
+	char line[512]; int cap = 0, ln = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		ln++;
+		for (char *c = line; *c; ++c) if (*c == ',') *c = ' ';
+		char *s = line + strspn(line, " \t");
+		if (*s == '#' || *s == '\n' || !*s) continue;
+		struct mt_region g; memset(&g, 0, sizeof(g));
+		if (sscanf(s, "%63s %d %d %d %d", g.name, &g.x0, &g.y0, &g.x1, &g.y1) != 5 || g.x0 > g.x1 || g.y0 > g.y1 || g.x0 < 1 || g.y0 < 1 || g.x1 > 9999 || g.y1 > 9999) {
+			print_error(2,"%s:%d: expected NAME X0 Y0 X1 Y1", path, ln); fclose(fp); return 2;
+		}
+		if (m->n == cap) {
+			struct mt_region *nr = realloc(m->r, (size_t)(cap = cap ? cap * 2 : 32) * sizeof(*nr));
+			if (!nr) { fclose(fp); print_error(1,"out of memory"); return 1; }
+			m->r = nr;
+		}
+		m->r[m->n++] = g;
+	}
+	fclose(fp);
+	if (!m->n) { print_error(2,"'%s' defines no regions", path); return 2; }
+	/* grid: count, prefix sums, fill; every list ordered by area so the first hit is the smallest */
+	for (int i = 0; i < m->n; ++i) {
+		if ((m->r[i].x1 - 1) / MT_GRID_W + 1 > m->gw) m->gw = (m->r[i].x1 - 1) / MT_GRID_W + 1;
+		if ((m->r[i].y1 - 1) / MT_GRID_H + 1 > m->gh) m->gh = (m->r[i].y1 - 1) / MT_GRID_H + 1;
+	}
+	int cells = m->gw * m->gh, total = 0;
+	m->start = calloc((size_t)cells + 1, sizeof(int));
+	if (!m->start) { print_error(1,"out of memory"); return 1; }
+	for (int pass = 0; pass < 2; ++pass) {
+		if (pass && !(m->list = malloc((size_t)total * sizeof(int) + 1))) { print_error(1,"out of memory"); return 1; }
+		int *fill = pass ? calloc((size_t)cells, sizeof(int)) : NULL;
+		if (pass && !fill) { print_error(1,"out of memory"); return 1; }
+		for (int i = 0; i < m->n; ++i) {
+			const struct mt_region *g = &m->r[i];
+			for (int gy = (g->y0 - 1) / MT_GRID_H; gy <= (g->y1 - 1) / MT_GRID_H; ++gy)
+				for (int gx = (g->x0 - 1) / MT_GRID_W; gx <= (g->x1 - 1) / MT_GRID_W; ++gx) {
+					int c = gy * m->gw + gx;
+					if (!pass) { m->start[c + 1]++; total++; continue; }
+					int *l = m->list + m->start[c], k = fill[c]++;
+					while (k > 0 && mt_area(&m->r[l[k - 1]]) > mt_area(g)) { l[k] = l[k - 1]; --k; }
+					l[k] = i;
+				}
+		}
+		if (!pass) for (int c = 0; c < cells; ++c) m->start[c + 1] += m->start[c];
+		free(fill);
+	}
+	return 0;
+}
+
+static int mt_inside(const struct mt_region *g, int x, int y) { return x >= g->x0 && x <= g->x1 && y >= g->y0 && y <= g->y1; }
+
+/* smallest region containing x,y, or -1 */
+static int mt_lookup(const struct mt_map *m, int x, int y)
+{
+	if (x < 1 || y < 1) return -1;
+	int gx = (x - 1) / MT_GRID_W, gy = (y - 1) / MT_GRID_H;
+	if (gx >= m->gw || gy >= m->gh) return -1;
+	int c = gy * m->gw + gx;
+	for (int k = m->start[c]; k < m->start[c + 1]; ++k) if (mt_inside(&m->r[m->list[k]], x, y)) return m->list[k];
+	return -1;
+}
+
+static int mt_nearest(const struct mt_map *m, int x, int y)
 {
-	if (motion) term_write("\x1b[?1000h\x1b[?1002h\x1b[?1006h", 24);
-	else term_write("\x1b[?1000h\x1b[?1006h", 16);
-	/* drain the chosen fd so sequences are sent */
-	if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
+	int best = 0; long bd = -1;
+	for (int i = 0; i < m->n; ++i) {
+		const struct mt_region *g = &m->r[i];
+		long dx = x < g->x0 ? g->x0 - x : x > g->x1 ? x - g->x1 : 0, dy = y < g->y0 ? g->y0 - y : y > g->y1 ? y - g->y1 : 0;
+		if (bd < 0 || dx * dx + dy * dy < bd) { bd = dx * dx + dy * dy; best = i; }
+	}
+	return best;
 }
 
-/* parse SGR "<Cb;Cx;CyM" */
-static int parse_sgr(const char *buf, size_t len, int *cb, int *cx, int *cy, char *termch)
+/* one movement: its start, and the positions since (for overshoot and re-entries) */
+struct mt_move { int have; double t0, ax, ay; int *px, *py; size_t n, cap; };
+
+static int mt_point(struct mt_move *mv, int x, int y)
 {
-	if (len < 4 || buf[0] != '<' || len >= SGR_BUF) return 0;
-	char tmp[SGR_BUF];
-	memcpy(tmp, buf+1, len-2);
-	tmp[len-2] = '\0';
-	char *p = tmp;
-	char *s1 = strchr(p,';'); if (!s1) return 0; *s1++ = '\0';
-	char *s2 = strchr(s1,';'); if (!s2) return 0; *s2++ = '\0';
-	errno = 0;
-	char *end;
-	long vcb = strtol(p,&end,10); if (errno || end==p) return 0;
-	long vcx = strtol(s1,&end,10); if (errno || end==s1) return 0;
-	long vcy = strtol(s2,&end,10); if (errno || end==s2) return 0;
-	*cb = (int)vcb; *cx = (int)vcx; *cy = (int)vcy; *termch = buf[len-1];
-	return 1;
+	if (mv->n == mv->cap) {
+		size_t cap = mv->cap ? mv->cap * 2 : 256;
+		int *nx = realloc(mv->px, cap * sizeof(int)), *ny = nx ? realloc(mv->py, cap * sizeof(int)) : NULL;
+		if (nx) mv->px = nx;
+		if (!ny) return -1;
+		mv->py = ny; mv->cap = cap;
+	}
+	mv->px[mv->n] = x; mv->py[mv->n] = y; mv->n++;
+	return 0;
 }
 
-/* read SGR event; return codes:
-   1 -> event
-   0 -> timeout
-  -1 -> EOF/error (or signal set)
-   2 -> Enter pressed
-*/
-static int read_sgr_event_timeout(event_t *ev, double timeout_sec, int want_motion)
+struct mt_fit { unsigned long long n; double sx, sy, sxx, sxy, syy; };
+
+static void mt_hit(struct mt_region *g, const struct mt_move *mv, int bx, int by, double t, double aspect, struct mt_fit *f)
 {
-	fd_set rfds; struct timeval tv;
-	time_t sec = (time_t)timeout_sec;
-	suseconds_t usec = (suseconds_t)((timeout_sec - (double)sec) * 1e6);
-	int rv;
-	for (;;) {
-		FD_ZERO(&rfds); FD_SET(ttyfd, &rfds);
-		if (timeout_sec < 0) rv = select(ttyfd+1, &rfds, NULL, NULL, NULL);
-		else { tv.tv_sec = sec; tv.tv_usec = usec; rv = select(ttyfd+1, &rfds, NULL, NULL, &tv); }
-		if (rv == -1) {
-			if (errno == EINTR) { if (got_sig) return -1; continue; }
-			return -1;
+	double cx = (g->x0 + g->x1) / 2.0, cy = (g->y0 + g->y1) / 2.0;
+	double dx = cx - mv->ax, dy = (cy - mv->ay) * aspect, d = m_sqrt(dx * dx + dy * dy);
+	double w = g->x1 - g->x0 + 1, h = (g->y1 - g->y0 + 1) * aspect;
+	double ux = d > 0 ? dx / d : 1.0, uy = d > 0 ? dy / d : 0.0;
+	double wx = ux != 0 ? w / (ux < 0 ? -ux : ux) : 1e300, wy = uy != 0 ? h / (uy < 0 ? -uy : uy) : 1e300;
+	double width = wx < wy ? wx : wy, id = m_log2(d / width + 1.0), mtime = t - mv->t0;
+	/* overshoot: farthest point past the press along start -> press; re-entries into the target */
+	double px = bx - mv->ax, py = (by - mv->ay) * aspect, pd = m_sqrt(px * px + py * py), over = 0.0;
+	int in = 0, entries = 0;
+	for (size_t i = 0; i < mv->n; ++i) {
+		if (pd > 0) {
+			double proj = ((mv->px[i] - mv->ax) * px + (mv->py[i] - mv->ay) * aspect * py) / pd - pd;
+			if (proj > over) over = proj;
 		}
-		if (rv == 0) return 0;
-		char c; ssize_t r = read(ttyfd, &c, 1);
-		if (r <= 0) return -1;
-		if (c == '\r' || c == '\n') return 2;
-		if ((unsigned char)c != 0x1b) continue;
-		if (read(ttyfd, &c, 1) <= 0) return -1; if (c != '[') continue;
-		if (read(ttyfd, &c, 1) <= 0) return -1; if (c != '<') continue;
-		char buf[SGR_BUF]; size_t len = 0; buf[len++] = '<';
-		while (len + 1 < sizeof(buf)) {
-			if (read(ttyfd, &c, 1) <= 0) return -1;
-			buf[len++] = c;
-			if (c == 'M' || c == 'm') break;
-		}
-		int cb,x,y; char termch = 0;
-		if (!parse_sgr(buf, len, &cb, &x, &y, &termch)) continue;
-		clock_gettime(CLOCK_MONOTONIC, &ev->t);
-		ev->button = cb; ev->x = x; ev->y = y;
-		if (termch == 'M') { if (cb < 32) ev->type = EVT_PRESS; else ev->type = EVT_MOTION; }
-		else ev->type = EVT_RELEASE;
-		return 1;
+		int now = mt_inside(g, mv->px[i], mv->py[i]);
+		if (now && !in) entries++;
+		in = now;
 	}
+	g->hits++; g->id_sum += id; g->mt_sum += mtime; g->over_sum += over;
+	if (entries > 1) g->reentries += (unsigned long long)(entries - 1);
+	f->n++; f->sx += id; f->sy += mtime; f->sxx += id * id; f->sxy += id * mtime; f->syy += mtime * mtime;
 }
 
-/* draw blue dot */
-static void draw_mark(int x, int y)
+static int metrics_main(int argc, char **argv)
 {
-	char seq[128];
-	int n = snprintf(seq, sizeof(seq),
-		"\x1b""7" "\x1b[%d;%dH" "\x1b[34m" "\u25CF" "\x1b[0m" "\x1b""8", y, x);
-	if (n>0) term_write(seq, (size_t)n);
-	/* flush to terminal fd */
-	if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
+	const char *regions = NULL;
+	double aspect = 2.0;
+	int json = 0;
+	static struct option fopts[] = {
+		{"regions", required_argument, NULL, 'r'},
+		{"aspect", required_argument, NULL, 'a'},
+		{"json", no_argument, NULL, 'j'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "r:a:j", fopts, NULL)) != -1) {
+		if (ch == 'r') regions = optarg;
+		else if (ch == 'a') { if (!parse_positive_double(optarg, &aspect)) { print_error(2,"--aspect requires a positive cell height/width ratio"); return 2; } }
+		else if (ch == 'j') json = 1;
+		else { print_error(2,"usage: metrics --regions FILE [--aspect R] [--json] LOG"); return 2; }
+	}
+	if (!regions || argc - optind != 1) { print_error(2,"metrics needs --regions FILE and one LOG"); return 2; }
+	struct mt_map m; memset(&m, 0, sizeof(m));
+	struct mt_move mv; memset(&mv, 0, sizeof(mv));
+	struct mt_fit fit; memset(&fit, 0, sizeof(fit));
+	const char *data = NULL; size_t len = 0; int mapped = 0;
+	int rc = mt_load(regions, &m);
+	if (rc) goto out;
+	if (an_map(argv[optind], &data, &len, &mapped) < 0) { print_error(3,"cannot read '%s': %s", argv[optind], strerror(errno)); rc = 3; goto out; }
+	struct acur c; struct arec r; int k;
+	double cum = 0.0;
+	unsigned long long repeats = 0;
+	an_open(&c, data, data + len);
+	while ((k = an_next(&c, &r)) >= 0) {
+		if (!k) continue;
+		if (r.has_dt) cum += r.dt;
+		double t = r.has_t ? r.t : cum;
+		if (!r.has_xy || r.type >= EVT_KEY) continue;
+		if (!mv.have) { mv.have = 1; mv.t0 = t; mv.ax = r.x; mv.ay = r.y; mv.n = 0; }
+		if (r.type == EVT_PRESS) {
+			int g = mt_lookup(&m, r.x, r.y);
+			if (g < 0) m.r[mt_nearest(&m, r.x, r.y)].misses++;
+			else if (mt_inside(&m.r[g], (int)mv.ax, (int)mv.ay)) repeats++;
+			else mt_hit(&m.r[g], &mv, r.x, r.y, t, aspect, &fit);
+		}
+		if (r.type == EVT_RELEASE) { mv.t0 = t; mv.ax = r.x; mv.ay = r.y; mv.n = 0; }
+		else if (mt_point(&mv, r.x, r.y) < 0) { print_error(1,"out of memory"); rc = 1; goto out; }
+	}
+	double den = (double)fit.n * fit.sxx - fit.sx * fit.sx;
+	double b = fit.n > 1 && den != 0 ? ((double)fit.n * fit.sxy - fit.sx * fit.sy) / den : 0.0;
+	double a = fit.n ? (fit.sy - b * fit.sx) / (double)fit.n : 0.0;
+	double vy = (double)fit.n * fit.syy - fit.sy * fit.sy;
+	double r2 = den != 0 && vy != 0 ? ((double)fit.n * fit.sxy - fit.sx * fit.sy) * ((double)fit.n * fit.sxy - fit.sx * fit.sy) / (den * vy) : 0.0;
+	double tp = b > 1e-9 ? 1.0 / b : 0.0;   /* a flat or falling fit has no throughput */
+	if (json) printf("{\"regions\":[");
+	else printf("%-16s %6s %6s %6s %8s %8s %9s %9s %10s\n", "region", "hits", "errors", "err%", "ID", "MT", "overshoot", "reentries", "ID/MT");
+	for (int i = 0, first = 1; i < m.n; ++i) {
+		const struct mt_region *g = &m.r[i];
+		unsigned long long tries = g->hits + g->misses;
+		double h = g->hits ? (double)g->hits : 1.0;
+		double err = tries ? 100.0 * (double)g->misses / (double)tries : 0.0, mtm = g->mt_sum / h;
+		double tpm = g->hits && g->mt_sum > 0 ? g->id_sum / g->mt_sum : 0.0;
+		if (json) {
+			printf("%s{\"name\":\"", first ? "" : ",");
+			fput_json_str(stdout, g->name, strlen(g->name));
+			printf("\",\"hits\":%llu,\"errors\":%llu,\"error_rate\":%.4f,\"id\":%.4f,\"mt\":%.6f,\"overshoot\":%.3f,\"reentries\":%llu,\"throughput\":%.4f}",
+				g->hits, g->misses, err / 100.0, g->id_sum / h, mtm, g->over_sum / h, g->reentries, tpm);
+		} else printf("%-16s %6llu %6llu %6.1f %8.3f %8.3f %9.2f %9llu %10.3f\n", g->name, g->hits, g->misses, err, g->id_sum / h, mtm, g->over_sum / h, g->reentries, tpm);
+		first = 0;
+	}
+	if (json) printf("],\"movements\":%llu,\"repeats\":%llu,\"fit\":{\"a\":%.6f,\"b\":%.6f,\"r2\":%.4f,\"throughput\":%.4f}}\n", fit.n, repeats, a, b, r2, tp);
+	else if (fit.n > 1) printf("fit: MT = %.3f %+.3f * ID s (r^2 %.3f), throughput %.3f bits/s over %llu movements (%llu repeat presses skipped)\n", a, b, r2, tp, fit.n, repeats);
+	else printf("fit: needs at least two movements (%llu found)\n", fit.n);
+out:
+	if (data) an_unmap(data, len, mapped);
+	free(m.r); free(m.start); free(m.list); free(mv.px); free(mv.py);
+	return rc;
 }
 
-/* color grad */
-static void color_gradient_idx(size_t i, size_t n, int *r, int *g, int *b)
+#ifdef MOUSE_TOOL_BENCH
+/* microbenchmarks (build with -DMOUSE_TOOL_BENCH, run "mouse-tool bench"): every case is
+   warmed up and calibrated to batches of >= BENCH_BATCH_NS, then timed over --reps
+   batches; reports ns/op mean, stddev and min, optionally as JSON (--out) and as a
+   delta against an earlier JSON run (--baseline) */
+#define BENCH_BATCH_NS 10000000ULL
+#define BENCH_REPS_MAX 100
+static volatile unsigned long bench_sink;    /* keeps results observable to the compiler */
+static event_t bench_ev[64];
+static FILE *bench_fp;
+static const char *const bench_sgr[] = { "<0;12;34M", "<35;200;50M", "<64;1;1M", "<2;999;999m" };
+
+static void bench_events_init(void)
 {
-	if (n<=1) { *r=255; *g=0; *b=0; return; }
-	double t = (double)i / (double)(n-1);
-	*r = (int)((1.0 - t)*255.0 + 0.5);
-	*g = (int)(t*255.0 + 0.5);
-	*b = 0;
-	if (*r<0) *r=0; if (*r>255) *r=255;
-	if (*g<0) *g=0; if (*g>255) *g=255;
+	for (int i = 0; i < 64; ++i) {
+		event_t *e = &bench_ev[i];
+		memset(e, 0, sizeof(*e));
+		e->x = 1 + (i * 37) % 240; e->y = 1 + (i * 11) % 60; e->t = (uint64_t)i * 8000000ULL;
+		switch (i % 8) {
+		case 0: case 1: e->type = EVT_PRESS; e->button = i % 3; break;
+		case 2: case 3: case 4: e->type = EVT_MOTION; e->button = 3; break;
+		case 5: e->type = EVT_RELEASE; break;
+		case 6: e->type = EVT_SCROLL; e->button = 4 + (i & 1); e->delta = (i & 1) ? 1 : -1; break;
+		default: e->type = EVT_KEY; e->key = 'a' + i % 26; e->mods = i % 5; break;
+		}
+	}
 }
 
-/* playback on alt buffer */
-static void playback_events_color(event_t *events, size_t n)
+static void bench_parse_sgr(size_t n)
 {
-	if (n == 0) return;
-	term_write("\x1b[?1049h", 8);
-	term_write("\x1b[?25l", 6);
-	if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
-	term_write("\x1b[2J", 4);
-	if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
+	unsigned long acc = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const char *s = bench_sgr[i & 3];
+		int cb, x, y; char term;
+		acc += (unsigned long)parse_sgr(s, strlen(s), &cb, &x, &y, &term) + (unsigned long)(cb + x + y);
+	}
+	bench_sink += acc;
+}
 
-	for (size_t i = 0; i < n && !got_sig; ++i) {
-		if (i>0) {
-			double dt = (events[i].t.tv_sec + events[i].t.tv_nsec*1e-9) -
-						(events[i-1].t.tv_sec + events[i-1].t.tv_nsec*1e-9);
-			if (dt > 0) {
-				if (dt > 0.5) dt = 0.5;
-				struct timespec ts = { .tv_sec = (time_t)dt, .tv_nsec = (long)((dt - (time_t)dt)*1e9) };
-				nanosleep(&ts, NULL);
-				if (got_sig) break;
-			}
-		}
-		int R,G,B; color_gradient_idx(i, n, &R,&G,&B);
-		char seq[256];
-		int row = events[i].y, col = events[i].x;
-		if (row<1) row=1; if (col<1) col=1;
-		int len = snprintf(seq, sizeof(seq), "\x1b[%d;%dH\x1b[38;2;%d;%d;%dm\u25CF\x1b[0m", row, col, R, G, B);
-		if (len>0) term_write(seq, (size_t)len);
-		if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
+/* whole tokenizer path: byte FSM, CSI classification and the cb table */
+static void bench_tokenize(size_t n)
+{
+	static const char chunk[] = "\x1b[<0;12;34M\x1b[<35;200;50M\x1b[<64;1;1M\x1b[<2;99;99m";
+	struct input *in = &tins[0];
+	unsigned long acc = 0;
+	event_t ev;
+	for (size_t i = 0; i < n; i += 4) {
+		memcpy(in->buf, chunk, sizeof(chunk) - 1);
+		in->r = 0; in->w = sizeof(chunk) - 1;
+		while (tk_scan(in, &ev) != TK_MORE) acc += (unsigned long)ev.x;
 	}
-	if (!got_sig) { struct timespec tpa = { .tv_sec = 1, .tv_nsec = 0 }; nanosleep(&tpa, NULL); }
-	term_write("\x1b[?25h", 6);
-	term_write("\x1b[?1049l", 8);
-	if (ttyfd == STDIN_FILENO) tcdrain(STDOUT_FILENO); else tcdrain(ttyfd);
+	bench_sink += acc;
 }
 
-/* helpers */
-static int parse_positive_int(const char *s, long *out) {
-	if (!s) return 0; errno = 0; char *end; long v = strtol(s,&end,10);
-	if (errno || end==s || *end!='\0' || v<=0) return 0; *out = v; return 1;
+static void bench_csv(size_t n) { for (size_t i = 0; i < n; ++i) bench_sink += (unsigned long)fprint_event_csv(bench_fp, &bench_ev[i & 63]); }
+static void bench_json(size_t n) { for (size_t i = 0; i < n; ++i) bench_sink += (unsigned long)fprint_event_json(bench_fp, &bench_ev[i & 63], 0.008, ","); }
+static void bench_pretty(size_t n) { for (size_t i = 0; i < n; ++i) bench_sink += (unsigned long)fprint_event_json(bench_fp, &bench_ev[i & 63], 0.008, ", "); }
+static void bench_jsonl(size_t n) { for (size_t i = 0; i < n; ++i) print_json_line(&bench_ev[i & 63], 0.008, bench_fp); }
+
+static void bench_gradient(size_t n)
+{
+	unsigned long acc = 0;
+	for (size_t i = 0; i < n; ++i) { int r, g, b; color_gradient_idx(i & 1023, 1024, &r, &g, &b); acc += (unsigned long)(r + g + b); }
+	bench_sink += acc;
 }
-static int parse_positive_double(const char *s, double *out) {
-	if (!s) return 0; errno = 0; char *end; double v = strtod(s,&end);
-	if (errno || end==s || *end!='\0' || v<=0.0) return 0; *out = v; return 1;
+
+static void bench_playback_frame(size_t n)
+{
+	char seq[256]; unsigned long acc = 0;
+	for (size_t i = 0; i < n; ++i) acc += (unsigned long)playback_frame_seq(seq, sizeof(seq), &bench_ev[i & 63], i & 1023, 1024);
+	bench_sink += acc;
 }
-static const char *type_str(evtype_t t) { if (t == EVT_PRESS) return "press"; if (t==EVT_RELEASE) return "release"; return "motion"; }
 
-/* print JSON history with metadata
-   Note: we count only press events for the "outputs" top-level field. */
-static void print_json_history(out_event_t *outs, size_t n, FILE *fp, int pretty, const char *mode, const char *started_at, double duration)
+static void bench_multiclick(size_t n)
 {
-	size_t press_count = 0;
-	for (size_t i = 0; i < n; ++i) if (outs[i].ev.type == EVT_PRESS) ++press_count;
+	long acc = 0;
+	for (size_t i = 0; i < n; ++i) acc += click_followup(&bench_ev[0], &bench_ev[i & 63]);
+	bench_sink += (unsigned long)acc;
+}
 
-	if (!fp) fp = stdout;
-	if (!pretty) {
-		fprintf(fp, "{\"mode\":\"%s\",\"started_at\":\"%s\",\"duration\":%.6f,\"outputs\":%zu,\"events\":[", mode, started_at, duration, press_count);
-		for (size_t i=0;i<n;++i) {
-			event_t *e = &outs[i].ev;
-			fprintf(fp, "%s{\"x\":%d,\"y\":%d,\"button\":%d,\"type\":\"%s\",\"dt\":%.6f}", (i==0)?"":",", e->x,e->y,e->button,type_str(e->type),outs[i].dt);
-		}
-		fprintf(fp, "]}\n");
-	} else {
-		fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"started_at\": \"%s\",\n  \"duration\": %.6f,\n  \"outputs\": %zu,\n  \"events\": [\n", mode, started_at, duration, press_count);
-		for (size_t i=0;i<n;++i) {
-			event_t *e = &outs[i].ev;
-			fprintf(fp, "    {\"x\":%d, \"y\":%d, \"button\":%d, \"type\":\"%s\", \"dt\":%.6f}%s\n",
-				e->x, e->y, e->button, type_str(e->type), outs[i].dt, (i+1<n)?",":"");
-		}
-		fprintf(fp, "  ]\n}\n");
-	}
-	fflush(fp);
+static const struct { const char *name; void (*fn)(size_t); } bench_cases[] = {
+	{ "parse_sgr", bench_parse_sgr },
+	{ "tokenize", bench_tokenize },
+	{ "format_csv", bench_csv },
+	{ "format_json", bench_json },
+	{ "format_pretty", bench_pretty },
+	{ "format_jsonl", bench_jsonl },
+	{ "color_gradient", bench_gradient },
+	{ "playback_frame", bench_playback_frame },
+	{ "multiclick", bench_multiclick },
+};
+
+/* ns/op of name in an earlier --out file, or <0 when absent */
+static double bench_baseline(const char *doc, const char *name)
+{
+	char key[96];
+	snprintf(key, sizeof(key), "\"name\":\"%s\"", name);
+	const char *p = doc ? strstr(doc, key) : NULL;
+	if (!p || !(p = strstr(p, "\"ns_per_op\":"))) return -1.0;
+	return strtod(p + 12, NULL);
 }
 
-/* print JSON from events (for record) */
-static void print_json_from_events(event_t *events, size_t n, FILE *fp, int pretty, const char *mode, const char *started_at, double duration)
+static int bench_main(int argc, char **argv)
 {
-	size_t press_count = 0;
-	for (size_t i=0;i<n;++i) if (events[i].type == EVT_PRESS) ++press_count;
+	long reps = 15;
+	const char *filter = NULL, *out_path = NULL, *base_path = NULL;
+	static struct option bopts[] = {
+		{"reps", required_argument, NULL, 'r'},
+		{"filter", required_argument, NULL, 'f'},
+		{"out", required_argument, NULL, 'o'},
+		{"baseline", required_argument, NULL, 'b'},
+		{0,0,0,0}
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "r:f:o:b:", bopts, NULL)) != -1) {
+		if (ch == 'r') { if (!parse_positive_int(optarg, &reps) || reps > BENCH_REPS_MAX) { print_error(2,"--reps requires 1..%d", BENCH_REPS_MAX); return 2; } }
+		else if (ch == 'f') filter = optarg;
+		else if (ch == 'o') out_path = optarg;
+		else if (ch == 'b') base_path = optarg;
+		else { print_error(2,"usage: bench [--reps N] [--filter NAME] [--out FILE] [--baseline FILE]"); return 2; }
+	}
+	char *base = NULL;
+	if (base_path) {
+		FILE *bf = fopen(base_path, "r");
+		if (!bf) { print_error(3,"cannot read baseline '%s': %s", base_path, strerror(errno)); return 3; }
+		size_t cap = 1 << 16, len = 0, r;
+		if (!(base = malloc(cap + 1))) { fclose(bf); print_error(1,"out of memory"); return 1; }
+		while ((r = fread(base + len, 1, cap - len, bf)) > 0) {
+			len += r;
+			if (len < cap) continue;
+			char *nb = realloc(base, cap * 2 + 1);
+			if (!nb) { free(base); fclose(bf); print_error(1,"out of memory"); return 1; }
+			base = nb; cap *= 2;
+		}
+		base[len] = '\0'; fclose(bf);
+	}
+	FILE *jf = NULL;
+	if (out_path && !(jf = fopen(out_path, "w"))) { print_error(3,"cannot open '%s': %s", out_path, strerror(errno)); return 3; }
 
-	if (!fp) fp = stdout;
-	if (!pretty) {
-		fprintf(fp, "{\"mode\":\"%s\",\"started_at\":\"%s\",\"duration\":%.6f,\"outputs\":%zu,\"events\":[", mode, started_at, duration, press_count);
-		for (size_t i=0;i<n;++i) {
-			event_t *e = &events[i];
-			double dt = 0.0;
-			if (i>0) dt = (e->t.tv_sec + e->t.tv_nsec*1e-9) - (events[i-1].t.tv_sec + events[i-1].t.tv_nsec*1e-9);
-			fprintf(fp, "%s{\"x\":%d,\"y\":%d,\"button\":%d,\"type\":\"%s\",\"dt\":%.6f}", (i==0)?"":",", e->x,e->y,e->button,type_str(e->type), dt);
+	tk_init(); cb_init(); bench_events_init();
+	bench_fp = fopen("/dev/null", "w");
+	if (!bench_fp) { print_error(1,"cannot open /dev/null"); return 1; }
+	static char bench_buf[1 << 16];
+	setvbuf(bench_fp, bench_buf, _IOFBF, sizeof(bench_buf));
+	flush_interval_ms = 1; /* formatters only: no per-event fflush */
+
+	printf("%-16s %12s %9s %12s %12s%s\n", "case", "ns/op", "stddev%", "min", "iters", base ? "      vs base" : "");
+	if (jf) fprintf(jf, "{\"reps\":%ld,\"results\":[", reps);
+	int first = 1;
+	for (size_t c = 0; c < sizeof(bench_cases)/sizeof(bench_cases[0]); ++c) {
+		if (filter && !strstr(bench_cases[c].name, filter)) continue;
+		void (*fn)(size_t) = bench_cases[c].fn;
+		/* warmup doubles the batch until it takes BENCH_BATCH_NS */
+		size_t iters = 1024;
+		for (;;) {
+			uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+			fn(iters);
+			if (clock_ns(CLOCK_MONOTONIC) - t0 >= BENCH_BATCH_NS || iters >= ((size_t)1 << 30)) break;
+			iters *= 2;
 		}
-		fprintf(fp, "]}\n");
-	} else {
-		fprintf(fp, "{\n  \"mode\": \"%s\",\n  \"started_at\": \"%s\",\n  \"duration\": %.6f,\n  \"outputs\": %zu,\n  \"events\": [\n", mode, started_at, duration, press_count);
-		for (size_t i=0;i<n;++i) {
-			event_t *e = &events[i];
-			double dt = 0.0;
-			if (i>0) dt = (e->t.tv_sec + e->t.tv_nsec*1e-9) - (events[i-1].t.tv_sec + events[i-1].t.tv_nsec*1e-9);
-			fprintf(fp, "    {\"x\":%d, \"y\":%d, \"button\":%d, \"type\":\"%s\", \"dt\":%.6f}%s\n",
-				e->x, e->y, e->button, type_str(e->type), dt, (i+1<n)?",":"");
+		double ns[BENCH_REPS_MAX], sum = 0.0, min = 0.0;
+		for (long r = 0; r < reps; ++r) {
+			uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+			fn(iters);
+			ns[r] = (double)(clock_ns(CLOCK_MONOTONIC) - t0) / (double)iters;
+			sum += ns[r];
+			if (!r || ns[r] < min) min = ns[r];
 		}
-		fprintf(fp, "  ]\n}\n");
+		double mean = sum / (double)reps, var = 0.0;
+		for (long r = 0; r < reps; ++r) var += (ns[r] - mean) * (ns[r] - mean);
+		double sd = reps > 1 ? m_sqrt(var / (double)(reps - 1)) : 0.0;
+		printf("%-16s %12.2f %8.1f%% %12.2f %12zu", bench_cases[c].name, mean, mean > 0 ? 100.0 * sd / mean : 0.0, min, iters);
+		double b = bench_baseline(base, bench_cases[c].name);
+		if (b > 0) printf("   %+9.1f%%", 100.0 * (mean - b) / b);
+		putchar('\n');
+		if (jf) fprintf(jf, "%s{\"name\":\"%s\",\"ns_per_op\":%.3f,\"stddev\":%.3f,\"min\":%.3f,\"iters\":%zu}",
+			first ? "" : ",", bench_cases[c].name, mean, sd, min, iters);
+		first = 0;
 	}
-	fflush(fp);
+	if (jf) { fprintf(jf, "]}\n"); fclose(jf); }
+	fclose(bench_fp);
+	free(base);
+	return 0;
 }
+#endif
 
-/* print single json line (jsonl) */
-static void print_json_line(event_t *e, double dt, FILE *fp)
-{
-	if (!fp) fp = stdout;
-	fprintf(fp, "{\"x\":%d,\"y\":%d,\"button\":%d,\"type\":\"%s\",\"dt\":%.6f}\n", e->x,e->y,e->button,type_str(e->type),dt);
-	fflush(fp);
-}
+/* menu subcommand: draws options on the terminal and prints the id of the one that is
+   clicked. Items are "[ID=]LABEL[@ROW,COL]" from the arguments, or one per line on stdin;
+   the ID defaults to the label, and items without a position are laid out by --layout
+   from --at. The first frame is one write; with --hover, pointer motion (or Tab/arrows)
+   highlights the item under it and only items whose highlight changed are redrawn.
+   Esc, q, Enter with nothing highlighted, or --timeout cancel with exit code 1. */
+#define MENU_MAX 256
+struct menu_item { char *id, *label; int row, col, w; };
+static struct { struct menu_item it[MENU_MAX]; int n; } menu;
 
-/* wait for first press (blocking). returns:
-   1 -> got press (ev filled)
-   0 -> failure/timeout/enter/signal
-*/
-static int wait_for_first_press(event_t *ev)
+/* parse one item spec in place */
+static int menu_add(char *s)
 {
-	while (!got_sig) {
-		int r = read_sgr_event_timeout(ev, -1.0, 0);
-		if (r == 1 && ev->type == EVT_PRESS) return 1;
-		if (r == 2) return 0; /* Enter pressed -> treat as failure/abort */
-		if (r == -1) return 0;
+	if (menu.n == MENU_MAX) return -1;
+	struct menu_item *m = &menu.it[menu.n];
+	m->row = m->col = 0;
+	char *eq = strchr(s, '=');
+	if (eq && eq != s && !memchr(s, ' ', (size_t)(eq - s))) { *eq = '\0'; m->id = s; s = eq + 1; }
+	else m->id = NULL;
+	char *at = strrchr(s, '@');
+	if (at) {
+		int r, c; char extra;
+		if (sscanf(at + 1, "%d,%d%c", &r, &c, &extra) == 2 && r > 0 && c > 0) { *at = '\0'; m->row = r; m->col = c; }
 	}
+	m->label = s;
+	if (!m->id) m->id = s;
+	m->w = 0;
+	for (const unsigned char *p = (const unsigned char *)s; *p; ++p) if ((*p & 0xc0) != 0x80) m->w++; /* cells: one per code point */
+	menu.n++;
 	return 0;
 }
 
-/* wait for N-1 more presses near (firstx,firsty). returns 0 success, 1 mismatch/timeout */
-static int wait_multiclick_followups(int firstx, int firsty, int total_N)
+static int menu_hit(int x, int y, int pad)
 {
-	if (total_N <= 1) return 0;
-	int count = 1;
-	event_t ev;
-	while (count < total_N && !got_sig) {
-		int r = read_sgr_event_timeout(&ev, MULTICLICK_MAX_GAP, 0);
-		if (r == 0) return 1; /* timeout */
-		if (r == -1) return 1;
-		if (r == 2) return 1; /* Enter -> treat as failure for multiclick */
-		if (ev.type != EVT_PRESS) continue;
-		int dx = firstx - ev.x, dy = firsty - ev.y;
-		if (dx*dx + dy*dy <= MULTICLICK_RADIUS * MULTICLICK_RADIUS) {
-			count++;
-			continue;
-		} else return 1;
+	for (int i = 0; i < menu.n; ++i) {
+		const struct menu_item *m = &menu.it[i];
+		if (y == m->row && x >= m->col && x < m->col + m->w + 2 * pad) return i;
 	}
-	return (count == total_N) ? 0 : 1;
+	return -1;
 }
 
-/* handle -c: print LAST click (not first) in selected format; if timeout/mismatch -> print none */
-static int handle_click_mode(int N, int out_mode_local, FILE *outfp, int do_mark_local, const char *started_at)
+/* append item i in its style to the frame buffer */
+static size_t menu_draw(char *buf, size_t cap, int i, int pad, const char *style)
 {
-	event_t first;
-	if (!wait_for_first_press(&first)) {
-		/* no first press (enter/signal/EOF) */
-		return 1;
-	}
+	const struct menu_item *m = &menu.it[i];
+	int k = snprintf(buf, cap, "\x1b[%d;%dH\x1b[%sm%*s%s%*s\x1b[0m", m->row, m->col, style, pad, "", m->label, pad, "");
+	return k > 0 && (size_t)k < cap ? (size_t)k : 0;
+}
 
-	/* accumulate N clicks that must be near the first; update 'last' to the most recent valid press */
-	event_t last = first;
-	if (N > 1) {
-		int count = 1;
-		event_t ev;
-		while (count < N && !got_sig) {
-			int r = read_sgr_event_timeout(&ev, MULTICLICK_MAX_GAP, 0);
-			if (r == 0) { /* timeout -> failure */
-				return 1;
-			}
-			if (r == -1) return 1;
-			if (r == 2) return 1; /* Enter pressed -> failure */
-			if (ev.type != EVT_PRESS) continue;
-			int dx = first.x - ev.x, dy = first.y - ev.y;
-			if (dx*dx + dy*dy <= MULTICLICK_RADIUS * MULTICLICK_RADIUS) {
-				count++;
-				last = ev;
-				continue;
-			} else {
-				/* too far -> failure */
-				return 1;
-			}
+static int menu_main(int argc, char **argv)
+{
+	int column = 0, gap = -1, pad = 1, hover = 0, index = 0, at_r = 2, at_c = 3;
+	double timeout = -1.0;
+	const char *style = "7", *hstyle = "1;7", *script_path = NULL;
+	static struct option fopts[] = {
+		{"layout", required_argument, NULL, 'L'},
+		{"at", required_argument, NULL, 'A'},
+		{"gap", required_argument, NULL, 'g'},
+		{"pad", required_argument, NULL, 'P'},
+		{"style", required_argument, NULL, 's'},
+		{"hover-style", required_argument, NULL, 'S'},
+		{"hover", no_argument, NULL, 'H'},
+		{"index", no_argument, NULL, 'x'},
+		{"timeout", required_argument, NULL, 't'},
+		{"script", required_argument, NULL, 'R'},
+		{0,0,0,0}
+	};
+	int ch; char extra;
+	while ((ch = getopt_long(argc, argv, "L:A:g:P:s:S:Hxt:R:", fopts, NULL)) != -1) {
+		if (ch == 'L') {
+			if (!strcmp(optarg, "row")) column = 0;
+			else if (!strcmp(optarg, "column")) column = 1;
+			else { print_error(2,"--layout must be row or column"); return 2; }
 		}
-		if (count != N) return 1;
+		else if (ch == 'A') { if (sscanf(optarg, "%d,%d%c", &at_r, &at_c, &extra) != 2 || at_r < 1 || at_c < 1) { print_error(2,"--at requires ROW,COL (1-based)"); return 2; } }
+		else if (ch == 'g' || ch == 'P') {
+			char *end; errno = 0;
+			long k = strtol(optarg, &end, 10);
+			if (errno || end == optarg || *end || k < 0 || k > 200) { print_error(2,"--%s requires a number of cells (0-200)", ch == 'g' ? "gap" : "pad"); return 2; }
+			if (ch == 'g') gap = (int)k; else pad = (int)k;
+		}
+		else if (ch == 's') style = optarg;
+		else if (ch == 'S') hstyle = optarg;
+		else if (ch == 'H') hover = 1;
+		else if (ch == 'x') index = 1;
+		else if (ch == 't') { if (!parse_positive_double(optarg, &timeout)) { print_error(2,"--timeout requires positive numeric seconds"); return 2; } }
+		else if (ch == 'R') script_path = optarg;
+		else { print_error(2,"usage: menu [--layout row|column] [--at ROW,COL] [--gap N] [--pad N] [--style SGR] [--hover [--hover-style SGR]] [--index] [--timeout SEC] [ITEM...]"); return 2; }
 	}
+	if (gap < 0) gap = column ? 0 : 2;
+	for (const char *p = style; *p; ++p) if (!strchr("0123456789;", *p)) { print_error(2,"--style takes SGR parameters, e.g. 42 or 1;37;44"); return 2; }
+	for (const char *p = hstyle; *p; ++p) if (!strchr("0123456789;", *p)) { print_error(2,"--hover-style takes SGR parameters, e.g. 42 or 1;37;44"); return 2; }
 
-	/* Success: emit the last click (not the first) */
-	if (do_mark_local) draw_mark(last.x, last.y);
-
-	if (out_mode_local == OUT_JSONL) {
-		print_json_line(&last, 0.0, outfp?outfp:stdout);
-	} else if (out_mode_local == OUT_JSON || out_mode_local == OUT_PRETTY) {
-		out_event_t *tmp = calloc(1, sizeof(*tmp));
-		if (!tmp) {
-			if (!outfp) outfp = stdout;
-			fprintf(outfp, "%d,%d,%d\n", last.x, last.y, last.button);
-			fflush(outfp);
-		} else {
-			tmp[0].ev = last; tmp[0].dt = 0.0;
-			print_json_history(tmp, 1, outfp?outfp:stdout, out_mode_local==OUT_PRETTY, "click", started_at, 0.0);
-			free(tmp);
+	/* items: arguments, else stdin lines */
+	if (optind < argc) {
+		for (int i = optind; i < argc; ++i)
+			if (menu_add(argv[i]) < 0) { print_error(2,"menu takes at most %d items", MENU_MAX); return 2; }
+	} else if (!isatty(STDIN_FILENO)) {
+		char *line = NULL; size_t cap = 0; ssize_t len;
+		while ((len = getline(&line, &cap, stdin)) > 0) {
+			while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+			if (!len) continue;
+			char *s = strdup(line);
+			if (!s || menu_add(s) < 0) { print_error(2,"menu takes at most %d items", MENU_MAX); free(line); return 2; }
 		}
+		free(line);
+	}
+	if (!menu.n) { print_error(2,"menu needs at least one item (arguments or stdin lines)"); return 2; }
+	for (int i = 0, r = at_r, c = at_c; i < menu.n; ++i) {
+		struct menu_item *m = &menu.it[i];
+		if (m->row) continue;
+		m->row = r; m->col = c;
+		if (column) r += 1 + gap; else c += m->w + 2 * pad + gap;
+	}
+
+	/* terminal: stdin may carry the items and stdout the answer, so fall back to /dev/tty */
+	if (script_path) {
+		char err[128];
+		if (script_load(script_path, err, sizeof(err)) < 0) { print_error(1,"cannot load script '%s': %s", script_path, err); return 1; }
+		ttys[0].fd = -1; ttys[0].path = script_path; ntty = 1;
+		ts_source = TS_VIRTUAL;
 	} else {
-		if (!outfp) outfp = stdout;
-		fprintf(outfp, "%d,%d,%d\n", last.x, last.y, last.button);
-		fflush(outfp);
+		if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+			ttyfd = open("/dev/tty", O_RDWR | O_NOCTTY | O_CLOEXEC);
+			if (ttyfd == -1) { print_error(2,"needs interactive terminal"); return 2; }
+		}
+		if (!isatty(ttyfd)) { print_error(2,"needs interactive terminal"); return 2; }
+		ttys[0].fd = ttyfd; ttys[0].owned = (ttyfd != STDIN_FILENO); ttys[0].path = "tty"; ntty = 1;
 	}
+	want_keys = 1;
+	atexit(restore_terminal);
+	install_signals();
+	signal(SIGWINCH, SIG_IGN); /* positions are absolute; a resize warning would draw over the menu */
+	int bad;
+	if (!script_path && tty_setup(&bad) == -1) { print_error(1,"cannot set terminal attributes on %s: %s", ttys[bad].path, strerror(errno)); return 1; }
+	ts_init();
+	tk_init();
+	cb_init();
+	if (script_path) tty_live = 1;
+	else if (tty_watch_start() == -1) { print_error(1,"cannot watch terminal input: %s", strerror(errno)); return 1; }
 
-	return 0;
-}
+	/* first frame: alternate screen, hidden cursor, mouse mode and every item in one write */
+	size_t cap = 64, n;
+	size_t slen = strlen(style) > strlen(hstyle) ? strlen(style) : strlen(hstyle);
+	for (int i = 0; i < menu.n; ++i) cap += strlen(menu.it[i].label) + slen + (size_t)(2 * pad) + 48;
+	char *frame = malloc(cap);
+	if (!frame) { print_error(1,"out of memory"); return 1; }
+	n = (size_t)snprintf(frame, cap, "\x1b[?1049h\x1b[?25l\x1b[2J\x1b[?1000h%s\x1b[?1006h\x1b[?2004h", hover ? "\x1b[?1003h" : "");
+	for (int i = 0; i < menu.n; ++i) n += menu_draw(frame + n, cap - n, i, pad, style);
+	tty_write(0, frame, n);
 
-/* help */
-static void print_help(const char *me)
-{
-	fprintf(stderr,
-"mouse-tool v1.0 (c) Kamil BuriXon Burek 2026\n"
-"Capture mouse clicks and movements, retrieve click positions, and record mouse activity directly in the terminal.\n\n"
-"Usage:\n"
-"  %s [options]\n\n"
-"Options:\n"
-"  -i, --infinite           keep running, print unique X,Y per change\n"
-"  -n, --count N            stop after N outputs (exclusive with --infinite)\n"
-"  -c, --click N            detect N clicks at same/near position (<=0.5s gap) and print last click (or none on timeout/mismatch)\n"
-"  -m, --mark               draw a dot at click position (works in any mode)\n"
-"  -r, --record SEC         record SEC seconds then playback colorized (old->red, new->green)\n"
-"  -j, --json               collect history and emit JSON at exit\n"
-"  -p, --pretty-json        same as --json but pretty-printed\n"
-"  -l, --jsonl              newline-delimited JSON output (streaming)\n"
-"  -o, --outfile FILE       append outputs to FILE or create it\n"
-"  -a, --append             append to existing outfile (use with -o)\n"
-"  -O, --overwrite          overwrite existing outfile (use with -o)\n"
-"  -N, --no-warn            suppress warnings\n"
-"  -h, --help               show this help\n\n"
-"Short options may be combined (e.g. -im or -mn7).\n"
-"CSV mode streams lines \"X,Y,button\" (default).\n"
-"JSON modes produce JSON metadata + events at exit; --jsonl streams newline-delimited JSON lines.\n"
-"Press Enter during continuous/recording to stop listening and finish normally (dump & playback).\n"
-"Exit codes: 0 ok, 1 general error / -c failure, 2 invalid parameter, 3 file not writable, 4 file exists.\n",
-	me);
+	int chosen = -1, lit = -1, rc = 1;
+	uint64_t deadline = timeout > 0 ? ts_now_ns() + (uint64_t)(timeout * 1e9) : 0;
+	event_t ev;
+	for (;;) {
+		if (got_sig) break;
+		double wait = -1.0;
+		if (deadline) { uint64_t now = ts_now_ns(); if (now >= deadline) break; wait = (double)(deadline - now) * 1e-9; }
+		int rv = read_sgr_event_timeout(&ev, wait, hover);
+		if (rv == -1) break;
+		if (rv == 0) continue;
+		if (rv == 2) { chosen = lit; break; } /* Enter picks the highlighted item */
+		int want = lit;
+		if (ev.type == EVT_PRESS && ev.button == 0) {
+			int h = menu_hit(ev.x, ev.y, pad);
+			if (h >= 0) { chosen = h; break; }
+		} else if (ev.type == EVT_MOTION && hover) want = menu_hit(ev.x, ev.y, pad);
+		else if (ev.type == EVT_KEY) {
+			if (ev.key == KEY_ESC || ev.key == 'q') break;
+			if (hover && (ev.key == KEY_TAB || ev.key == KEY_DOWN || ev.key == KEY_RIGHT)) want = (lit + 1) % menu.n;
+			if (hover && (ev.key == KEY_BACKTAB || ev.key == KEY_UP || ev.key == KEY_LEFT)) want = lit <= 0 ? menu.n - 1 : lit - 1;
+		}
+		if (want == lit) continue;
+		/* redraw only the two items whose highlight changed */
+		n = 0;
+		if (lit >= 0) n += menu_draw(frame + n, cap - n, lit, pad, style);
+		if (want >= 0) n += menu_draw(frame + n, cap - n, want, pad, hstyle);
+		tty_write(0, frame, n);
+		lit = want;
+	}
+	free(frame);
+	restore_terminal();
+	if (chosen >= 0) {
+		if (index) printf("%d\n", chosen + 1);
+		else printf("%s\n", menu.it[chosen].id);
+		rc = 0;
+	}
+	return rc;
 }
 
 /* main */
@@ -467,11 +5239,14 @@ int main(int argc, char **argv)
 	int click_N = 0;
 	int record_mode = 0;
 	double record_seconds = 0.0;
-	int out_mode = OUT_CSV;
 	int append_flag = 0;
 	int overwrite_flag = 0;
 	char *outfile_path = NULL;
+	char *metrics_addr = NULL;
+	char *control_path = NULL;
+	char *script_path = NULL;
 
+	enum { OPT_FOCUS = 256, OPT_SCROLL_COALESCE, OPT_IDLE_TIMEOUT, OPT_MAX_DURATION, OPT_FLUSH_INTERVAL, OPT_STATS_INTERVAL, OPT_CLOCK, OPT_METRICS, OPT_TTY, OPT_CONTROL, OPT_SCRIPT, OPT_DWELL, OPT_DWELL_CELL, OPT_DWELL_MAP, OPT_DEBOUNCE, OPT_FILTER, OPT_BIND, OPT_BIND_JOBS };
 	static struct option longopts[] = {
 		{"infinite", no_argument, NULL, 'i'},
 		{"count", required_argument, NULL, 'n'},
@@ -484,13 +5259,47 @@ int main(int argc, char **argv)
 		{"outfile", required_argument, NULL, 'o'},
 		{"append", no_argument, NULL, 'a'},
 		{"overwrite", no_argument, NULL, 'O'},
+		{"keys", no_argument, NULL, 'k'},
+		{"focus", no_argument, NULL, OPT_FOCUS},
+		{"scroll-coalesce", required_argument, NULL, OPT_SCROLL_COALESCE},
+		{"idle-timeout", required_argument, NULL, OPT_IDLE_TIMEOUT},
+		{"max-duration", required_argument, NULL, OPT_MAX_DURATION},
+		{"flush-interval", required_argument, NULL, OPT_FLUSH_INTERVAL},
+		{"stats-interval", required_argument, NULL, OPT_STATS_INTERVAL},
+		{"timestamps", no_argument, NULL, 'T'},
+		{"clock", required_argument, NULL, OPT_CLOCK},
+		{"metrics", required_argument, NULL, OPT_METRICS},
+		{"tty", required_argument, NULL, OPT_TTY},
+		{"control", required_argument, NULL, OPT_CONTROL},
+		{"script", required_argument, NULL, OPT_SCRIPT},
+		{"debounce", required_argument, NULL, OPT_DEBOUNCE},
+		{"filter", required_argument, NULL, OPT_FILTER},
+		{"dwell", required_argument, NULL, OPT_DWELL},
+		{"dwell-cell", required_argument, NULL, OPT_DWELL_CELL},
+		{"dwell-map", required_argument, NULL, OPT_DWELL_MAP},
+		{"bind", required_argument, NULL, OPT_BIND},
+		{"bind-jobs", required_argument, NULL, OPT_BIND_JOBS},
 		{"no-warn", no_argument, NULL, 'N'},
 		{"help", no_argument, NULL, 'h'},
 		{0,0,0,0}
 	};
 
+	/* offline subcommands */
+	if (argc > 1 && !strcmp(argv[1], "analyze")) return analyze_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "convert")) return convert_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "merge")) return merge_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "index")) return index_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "query")) return query_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "menu")) return menu_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "compact")) return compact_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "compare")) return compare_main(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "metrics")) return metrics_main(argc - 1, argv + 1);
+#ifdef MOUSE_TOOL_BENCH
+	if (argc > 1 && !strcmp(argv[1], "bench")) return bench_main(argc - 1, argv + 1);
+#endif
+
 	int ch;
-	while ((ch = getopt_long(argc, argv, "in:c:mr:o:apOlNjh", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "in:c:mr:o:apOlkTNjh", longopts, NULL)) != -1) {
 		if (ch == 'i') infinite = 1;
 		else if (ch == 'n') { long v; if (!parse_positive_int(optarg,&v)) { print_error(2,"--count/-n requires positive integer"); return 2; } count_limit = (int)v; }
 		else if (ch == 'c') { long v; if (!parse_positive_int(optarg,&v)) { print_error(2,"--click/-c requires positive integer"); return 2; } click_mode = 1; click_N = (int)v; }
@@ -502,6 +5311,55 @@ int main(int argc, char **argv)
 		else if (ch == 'o') { if (!optarg) { print_error(2,"--outfile/-o requires a file path"); return 2; } outfile_path = optarg; }
 		else if (ch == 'a') append_flag = 1;
 		else if (ch == 'O') overwrite_flag = 1;
+		else if (ch == 'k') want_keys = 1;
+		else if (ch == OPT_FOCUS) want_focus = 1;
+		else if (ch == OPT_SCROLL_COALESCE) { double v; if (!parse_positive_double(optarg,&v)) { print_error(2,"--scroll-coalesce requires positive milliseconds"); return 2; } scroll_frame = v / 1000.0; }
+		else if (ch == OPT_IDLE_TIMEOUT) { if (!parse_positive_double(optarg,&idle_timeout)) { print_error(2,"--idle-timeout requires positive numeric seconds"); return 2; } }
+		else if (ch == OPT_MAX_DURATION) { if (!parse_positive_double(optarg,&max_duration)) { print_error(2,"--max-duration requires positive numeric seconds"); return 2; } }
+		else if (ch == OPT_FLUSH_INTERVAL) { long v; if (!parse_positive_int(optarg,&v)) { print_error(2,"--flush-interval requires positive milliseconds"); return 2; } flush_interval_ms = (uint64_t)v; }
+		else if (ch == OPT_STATS_INTERVAL) { double v; if (!parse_positive_double(optarg,&v)) { print_error(2,"--stats-interval requires positive numeric seconds"); return 2; } stats_interval_ms = (uint64_t)(v * 1000.0 + 0.5); }
+		else if (ch == 'T') want_ts = 1;
+		else if (ch == OPT_METRICS) metrics_addr = optarg;
+		else if (ch == OPT_CONTROL) control_path = optarg;
+		else if (ch == OPT_SCRIPT) script_path = optarg;
+		else if (ch == OPT_FILTER) {
+			const char *err; int col;
+			if (fl_compile(optarg, &err, &col) < 0) { print_error(2,"--filter: %s at column %d", err, col); return 2; }
+		}
+		else if (ch == OPT_DEBOUNCE) {
+			char *end, *end2;
+			errno = 0;
+			double ms = strtod(optarg, &end), dup = *end == ',' ? strtod(end + 1, &end2) : ms;
+			if (*end == ',' && (end2 == end + 1 || *end2)) end = NULL;
+			else if (*end == ',') end = end2;
+			if (errno || !end || end == optarg || *end || ms <= 0 || dup < 0 || ms > 60000 || dup > 60000) { print_error(2,"--debounce requires MS[,DUP_MS] (milliseconds)"); return 2; }
+			debounce_ns = (uint64_t)(ms * 1e6 + 0.5); debounce_dup_ns = (uint64_t)(dup * 1e6 + 0.5);
+		}
+		else if (ch == OPT_DWELL) {
+			int r, ms; char extra;
+			if (sscanf(optarg, "%d,%d%c", &r, &ms, &extra) != 2 || r < 0 || r > 1000 || ms <= 0) { print_error(2,"--dwell requires RADIUS,MS (cells >= 0, milliseconds > 0)"); return 2; }
+			dwell_r = r; dwell_ms = (uint64_t)ms;
+		}
+		else if (ch == OPT_DWELL_CELL) {
+			char extra;
+			if (sscanf(optarg, "%dx%d%c", &dwell_cw, &dwell_ch, &extra) != 2 || dwell_cw < 1 || dwell_ch < 1) { print_error(2,"--dwell-cell requires WxH (cells)"); return 2; }
+		}
+		else if (ch == OPT_DWELL_MAP) dwell_map = optarg;
+		else if (ch == OPT_BIND) {
+			if (optarg[0] == '@') {
+				char err[128];
+				if (bind_load(optarg + 1, err, sizeof(err)) < 0) { print_error(2,"--bind: cannot load '%s': %s", optarg + 1, err); return 2; }
+			} else {
+				const char *e = bind_parse(optarg);
+				if (e) { print_error(2,"--bind: %s", e); return 2; }
+			}
+		}
+		else if (ch == OPT_BIND_JOBS) { long v; if (!parse_positive_int(optarg,&v) || v > BIND_JOBS_MAX) { print_error(2,"--bind-jobs requires 1-%d", BIND_JOBS_MAX); return 2; } bind_jobs = (int)v; }
+		else if (ch == OPT_TTY) {
+			if (ntty == TTY_MAX) { print_error(2,"--tty may be given at most %d times", TTY_MAX); return 2; }
+			ttys[ntty].fd = -1; ttys[ntty++].path = optarg; tty_tagged = 1;
+		}
+		else if (ch == OPT_CLOCK) { if (!ts_select(optarg)) { print_error(2,"--clock must be monotonic, raw, boottime or tsc"); return 2; } }
 		else if (ch == 'N') no_warn = 1;
 		else if (ch == 'h') { print_help(argv[0]); return 0; }
 		else { print_error(2,"unknown parameter"); return 2; }
@@ -511,22 +5369,47 @@ int main(int argc, char **argv)
 	if (infinite && count_limit) { print_error(2,"--infinite and --count are exclusive"); return 2; }
 	if (click_mode && (infinite || count_limit || record_mode)) { print_error(2,"--click is exclusive with --infinite/--count/--record"); return 2; }
 	if (record_mode && click_mode) { print_error(2,"--record and --click are exclusive"); return 2; }
+	if (script_path && tty_tagged) { print_error(2,"--script and --tty are exclusive"); return 2; }
+	if (dwell_map && !dwell_ms) { print_error(2,"--dwell-map needs --dwell"); return 2; }
+	if (dwell_ms && dw_init() < 0) { print_error(1,"cannot allocate dwell table"); return 1; }
+	if (fl_n && click_mode) { print_error(2,"--filter does not apply to --click"); return 2; }
+	if (nbinds && (click_mode || record_mode)) { print_error(2,"--bind does not apply to --click or --record"); return 2; }
+	for (int i = 0; i < nbinds; ++i)
+		if (binds[i].trig == BT_DWELL && !dwell_ms) { print_error(2,"--bind %d: dwell trigger needs --dwell", i + 1); return 2; }
 
-	/* If stdout or stdin are not ttys, try to open /dev/tty for terminal interactions.
-	   This preserves ability to capture mouse from the controlling terminal while
-	   allowing stdout to be a pipe (so "$(mouse-tool)" works). */
-	if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
-		int tfd = open("/dev/tty", O_RDWR | O_NOCTTY);
-		if (tfd != -1) {
-			ttyfd = tfd;
-		} else {
-			/* fallback to original behaviour: require interactive terminal */
-			print_error(2,"needs interactive terminal");
-			return 2;
+	if (script_path) {
+		/* --script: the script is source 0 and the clock is virtual; nothing is drawn */
+		char err[128];
+		if (script_load(script_path, err, sizeof(err)) < 0) { print_error(1,"cannot load script '%s': %s", script_path, err); return 1; }
+		ttys[0].fd = -1; ttys[0].path = script_path; ntty = 1;
+		ts_source = TS_VIRTUAL;
+	} else if (tty_tagged) {
+		/* --tty: every listed terminal is a source; the first one also gets playback */
+		for (int i = 0; i < ntty; ++i) {
+			ttys[i].fd = open(ttys[i].path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+			if (ttys[i].fd == -1) { print_error(1,"cannot open tty '%s': %s", ttys[i].path, strerror(errno)); return 1; }
+			ttys[i].owned = 1;
+			if (!isatty(ttys[i].fd)) { print_error(2,"'%s' is not a terminal", ttys[i].path); return 2; }
+		}
+		ttyfd = ttys[0].fd;
+	} else {
+		/* If stdout or stdin are not ttys, try to open /dev/tty for terminal interactions.
+		   This preserves ability to capture mouse from the controlling terminal while
+		   allowing stdout to be a pipe (so "$(mouse-tool)" works). */
+		if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+			int tfd = open("/dev/tty", O_RDWR | O_NOCTTY);
+			if (tfd != -1) {
+				ttyfd = tfd;
+			} else {
+				/* fallback to original behaviour: require interactive terminal */
+				print_error(2,"needs interactive terminal");
+				return 2;
+			}
 		}
-	}
 
-	if (!isatty(ttyfd)) { print_error(2,"needs interactive terminal"); return 2; }
+		if (!isatty(ttyfd)) { print_error(2,"needs interactive terminal"); return 2; }
+		ttys[0].fd = ttyfd; ttys[0].owned = (ttyfd != STDIN_FILENO); ttys[0].path = "tty"; ntty = 1;
+	}
 
 	/* outfile handling */
 	if (append_flag && !outfile_path) { print_warn("append requested but no outfile specified; continuing without append"); append_flag = 0; }
@@ -537,78 +5420,90 @@ int main(int argc, char **argv)
 			if (!append_flag && !overwrite_flag) { print_error(4,"output file '%s' exists (use -a to append or -O to overwrite)", outfile_path); if (ttyfd != STDIN_FILENO) close(ttyfd); return 4; }
 			if (access(outfile_path, W_OK) != 0) { print_error(3,"output file '%s' is not writable", outfile_path); if (ttyfd != STDIN_FILENO) close(ttyfd); return 3; }
 		}
-		if (append_flag) out_fp = fopen(outfile_path, "a");
-		else out_fp = fopen(outfile_path, "w");
+		if (append_flag) out_fp = fopen(outfile_path, "ae");
+		else out_fp = fopen(outfile_path, "we");
 		if (!out_fp) { print_error(3,"cannot open output file '%s': %s", outfile_path, strerror(errno)); if (ttyfd != STDIN_FILENO) close(ttyfd); return 3; }
 	}
 
-	/* setup tty attributes on ttyfd (which may be STDIN_FILENO or /dev/tty) */
-	if (tcgetattr(ttyfd, &orig_tio) == -1) { print_error(1,"tcgetattr failed: %s", strerror(errno)); if (ttyfd != STDIN_FILENO) close(ttyfd); return 1; }
-	struct termios tio = orig_tio;
-	tio.c_lflag &= ~(ICANON | ECHO);
-	tio.c_cc[VMIN] = 1; tio.c_cc[VTIME] = 0;
-	if (tcsetattr(ttyfd, TCSANOW, &tio) == -1) { print_error(1,"tcsetattr failed: %s", strerror(errno)); if (ttyfd != STDIN_FILENO) close(ttyfd); return 1; }
+	/* setup tty attributes on every source; restore is registered first so that
+	   terminals already switched are restored on any later exit path */
 	atexit(restore_terminal);
 	install_signals();
+	int bad;
+	if (!script_path && tty_setup(&bad) == -1) { print_error(1,"cannot set terminal attributes on %s: %s", ttys[bad].path, strerror(errno)); return 1; }
+	ts_init();
+	ts_iso(ts_now_ns(), hist.started_at, sizeof(hist.started_at));
+	if (metrics_addr) {
+		int mrc = metrics_open(metrics_addr);
+		if (mrc == 2) { print_error(2,"--metrics requires unix:PATH or [127.0.0.1:]PORT"); return 2; }
+		if (mrc) { print_error(1,"cannot open metrics listener '%s': %s", metrics_addr, strerror(errno)); return 1; }
+	}
+	if (control_path) {
+		int crc = ctl_open(control_path);
+		if (crc == 2) { print_error(2,"--control requires a socket path"); return 2; }
+		if (crc) { print_error(1,"cannot open control socket '%s': %s", control_path, strerror(errno)); return 1; }
+	}
+	if (bind_setup() < 0) { print_error(1,"cannot watch --bind commands: %s", strerror(errno)); return 1; }
+	tk_init();
+	cb_init();
+	if (script_path) tty_live = 1;
+	else if (tty_watch_start() == -1) { print_error(1,"cannot watch terminal input: %s", strerror(errno)); return 1; }
 
 	/* click mode: wait for first press, print it according to format, then wait for followups */
 	if (click_mode) {
 		enable_mouse_reporting(0);
-		char started_at[64] = ""; { time_t t = time(NULL); struct tm g; gmtime_r(&t,&g); strftime(started_at, sizeof(started_at), "%Y-%m-%dT%H:%M:%SZ", &g); }
-		int rc = handle_click_mode(click_N, out_mode, out_fp, do_mark, started_at);
+		session_timers_start(0.0);
+		int rc = handle_click_mode(click_N, out_mode, out_fp, do_mark, hist.started_at);
 		restore_terminal();
 		return rc == 0 ? 0 : 1;
 	}
 
-	int want_motion = (infinite || record_mode || count_limit > 0) ? 1 : 0;
+	int want_motion = (infinite || record_mode || count_limit > 0 || dwell_ms || bind_need_motion()) ? 1 : 0;
 	enable_mouse_reporting(want_motion);
 
 	/* allocate events if record */
-	event_t *events = NULL;
-	size_t ev_count = 0, max_events = 0;
 	if (record_mode) {
 		size_t est = (size_t)(record_seconds * 1000.0) + 1024;
 		if (est > MAX_EVENTS) est = MAX_EVENTS;
-		max_events = est;
-		events = calloc(max_events, sizeof(*events));
-		if (!events) { print_error(1,"cannot allocate events buffer"); return 1; }
+		hist.max_events = est;
+		hist.events = calloc(hist.max_events, sizeof(*hist.events));
+		if (!hist.events) { print_error(1,"cannot allocate events buffer"); return 1; }
+	} else if ((out_mode == OUT_JSON || out_mode == OUT_PRETTY) && hist_reserve() < 0) {
+		print_error(1,"cannot allocate history buffer"); return 1;
 	}
+	/* static stdio buffer, so not even the first write allocates */
+	static char out_buf[1 << 16];
+	FILE *ofp = out_fp ? out_fp : stdout;
+	setvbuf(ofp, out_buf, isatty(fileno(ofp)) ? _IOLBF : _IOFBF, sizeof(out_buf));
 
-	out_event_t *outs = NULL; size_t outs_count = 0, outs_cap = 0;
 
 	event_t ev; event_t last_print = {0}; int have_last_print = 0;
 	int outputs = 0; /* counts only PRESS events */
-	struct timespec rec_start, now, last_emit_time = {0};
+	uint64_t last_emit_time = 0;
 
-	if (record_mode) clock_gettime(CLOCK_MONOTONIC, &rec_start);
+	/* record length, idle/max duration, flush and stats ticks all live on the timer wheel;
+	   the read blocks exactly until the nearest of them */
+	session_timers_start(record_mode ? record_seconds : 0.0);
 
 	/* main loop */
 	for (;;) {
 		if (got_sig) break;
-		/* compute timeout */
-		double timeout = -1.0;
-		if (record_mode) {
-			clock_gettime(CLOCK_MONOTONIC, &now);
-			double elapsed = (now.tv_sec - rec_start.tv_sec) + (now.tv_nsec - rec_start.tv_nsec) * 1e-9;
-			double remaining = record_seconds - elapsed;
-			if (remaining <= 0.0) break;
-			timeout = remaining;
-		}
 
-		int rv = read_sgr_event_timeout(&ev, timeout, want_motion);
+		int rv = read_event_dwell(&ev, -1.0, want_motion);
 		if (rv == -1) break;
-		if (rv == 0) {
-			/* timeout */
-			if (record_mode) continue;
-			else continue;
-		}
-		if (rv == 2) { /* Enter pressed */
+		if (rv == 0) continue; /* timer wakeup */
+		if (rv == 2) { /* Enter pressed, or record/idle/max duration reached */
 			break;
 		}
+		if (paused) continue; /* control "pause" */
+		if (fl_n && !fl_match(&ev)) { stats.filtered++; continue; } /* --filter, before any output */
 
-		/* record mode: just store */
+		/* record mode: just store (mouse events only, playback has no use for keys) */
 		if (record_mode) {
-			if (ev_count < max_events) events[ev_count++] = ev;
+			if (ev.type >= EVT_KEY) continue;
+			if (hist.ev_count < hist.max_events) hist.events[hist.ev_count++] = ev;
+			else stats.dropped++;
+			stats.history = hist.ev_count;
 			continue;
 		}
 
@@ -618,42 +5513,26 @@ int main(int argc, char **argv)
 		   but for immediate CSV emission and for counting we only consider PRESS. */
 
 		/* mark if requested only for presses */
-		if (do_mark && ev.type == EVT_PRESS) draw_mark(ev.x, ev.y);
+		if (do_mark && ev.type == EVT_PRESS) draw_mark(ev.src, ev.x, ev.y);
 
-		/* compute dt relative to last_emit_time for JSONL or outs */
+		/* dt relative to the previous emitted event, from the read-time stamps */
 		double dt = 0.0;
-		struct timespec cur; clock_gettime(CLOCK_MONOTONIC, &cur);
-		if (last_emit_time.tv_sec != 0 || last_emit_time.tv_nsec != 0) {
-			dt = (cur.tv_sec - last_emit_time.tv_sec) + (cur.tv_nsec - last_emit_time.tv_nsec) * 1e-9;
-		}
-		last_emit_time = cur;
+		if (last_emit_time) dt = (double)(ev.t - last_emit_time) * 1e-9;
+		last_emit_time = ev.t;
 
 		/* JSONL: stream every event (press/release/motion) as they come */
 		if (out_mode == OUT_JSONL) {
-			print_json_line(&ev, dt, out_fp?out_fp:stdout);
+			stream_event(out_fp?out_fp:stdout, &ev, dt, 0);
 		} else if (out_mode == OUT_JSON || out_mode == OUT_PRETTY) {
 			/* store every event for final JSON dump (so JSON will show press+release/motions) */
-			if (outs_count + 1 > outs_cap) {
-				size_t newcap = outs_cap ? outs_cap * 2 : 256;
-				out_event_t *tmp = realloc(outs, newcap * sizeof(*tmp));
-				if (!tmp) {
-					print_error(1, "out of memory");
-					break;
-				}
-				outs = tmp; outs_cap = newcap;
-			}
-			outs[outs_count].ev = ev;
-			outs[outs_count].dt = dt;
-			outs_count++;
-		} else { /* CSV mode: only emit PRESS events (X,Y,button) once per press */
-			if (ev.type == EVT_PRESS) {
-				FILE *fp = out_fp ? out_fp : stdout;
-				fprintf(fp, "%d,%d,%d\n", ev.x, ev.y, ev.button);
-				fflush(fp);
-			} else {
-				/* ignore release/motion for CSV */
-			}
+			hist_push(&ev, dt);
+		} else { /* CSV mode: only emit PRESS events (X,Y,button) once per press, plus key/focus/paste tokens */
+			stream_event(out_fp?out_fp:stdout, &ev, dt, 1);
 		}
+		/* runtime sinks stream CSV in CSV mode, JSONL otherwise */
+		for (int i = 0; i < nsinks; ++i) stream_event(sinks[i].fp, &ev, dt, out_mode == OUT_CSV);
+		MT_PROBE5(event_emit, ev.x, ev.y, (int)ev.type, ev.button, ev.t);
+		if (nbinds) bind_event(&ev);
 
 		/* increment outputs only for press events (so -n and default behavior count presses) */
 		if (ev.type == EVT_PRESS) outputs++;
@@ -671,50 +5550,41 @@ int main(int argc, char **argv)
 	}
 
 	/* finished main loop */
-	/* restore terminal at end (will also close /dev/tty if we opened it) after handling outputs */
+	dwell_finish();
+	/* restore terminal at end after handling outputs */
 	if (record_mode) {
 		/* playback and dump events */
-		char started_at[64] = ""; { time_t t = time(NULL); struct tm g; gmtime_r(&t,&g); strftime(started_at, sizeof(started_at), "%Y-%m-%dT%H:%M:%SZ", &g); }
-		/* compute duration */
-		double duration = 0.0;
-		if (ev_count > 1) {
-			duration = (events[ev_count-1].t.tv_sec - events[0].t.tv_sec) + (events[ev_count-1].t.tv_nsec - events[0].t.tv_nsec)*1e-9;
-		}
 		restore_terminal();
-		playback_events_color(events, ev_count);
+		playback_events_color(hist.events, hist.ev_count);
 		if (out_mode == OUT_JSONL) {
-			for (size_t i=0;i<ev_count;++i) {
+			for (size_t i=0;i<hist.ev_count;++i) {
 				double dt = 0.0;
-				if (i>0) dt = (events[i].t.tv_sec + events[i].t.tv_nsec*1e-9) - (events[i-1].t.tv_sec + events[i-1].t.tv_nsec*1e-9);
-				print_json_line(&events[i], dt, out_fp?out_fp:stdout);
+				if (i>0) dt = (double)(hist.events[i].t - hist.events[i-1].t) * 1e-9;
+				print_json_line(&hist.events[i], dt, out_fp?out_fp:stdout);
 			}
 		} else if (out_mode == OUT_JSON || out_mode == OUT_PRETTY) {
-			print_json_from_events(events, ev_count, out_fp?out_fp:stdout, out_mode==OUT_PRETTY, "record", started_at, duration);
+			hist_dump_json(out_fp?out_fp:stdout, out_mode==OUT_PRETTY);
 		} else {
 			/* CSV */
 			FILE *fp = out_fp ? out_fp : stdout;
-			for (size_t i=0;i<ev_count;++i) {
-				if (events[i].type == EVT_PRESS) fprintf(fp, "%d,%d,%d\n", events[i].x, events[i].y, events[i].button);
+			for (size_t i=0;i<hist.ev_count;++i) {
+				if (hist.events[i].type == EVT_PRESS) fprint_event_csv(fp, &hist.events[i]);
 			}
 			fflush(fp);
 		}
-		free(events);
+		free(hist.events);
 	} else {
 		/* non-record: if JSON history requested, print stored outs */
 		if (out_mode == OUT_JSON || out_mode == OUT_PRETTY) {
-			char started_at[64] = ""; { time_t t = time(NULL); struct tm g; gmtime_r(&t,&g); strftime(started_at, sizeof(started_at), "%Y-%m-%dT%H:%M:%SZ", &g); }
-			double duration = 0.0;
-			if (outs_count > 1) {
-				duration = 0.0;
-				for (size_t i=0;i<outs_count;++i) duration += outs[i].dt;
-			}
 			restore_terminal();
-			print_json_history(outs, outs_count, out_fp?out_fp:stdout, out_mode==OUT_PRETTY, "stream", started_at, duration);
-			free(outs);
+			hist_dump_json(out_fp?out_fp:stdout, out_mode==OUT_PRETTY);
+			hist_free();
 		} else {
 			restore_terminal();
 		}
 	}
+	if (stats.dropped) print_warn("history full: %llu events were not kept", stats.dropped);
+	bind_finish();
 
 	return 0;
 }
@@ -0,0 +1,98 @@
+#!/bin/bash
+# Regression tests. Every tests/scenarios/NAME.script runs on the virtual clock
+# (--script) with the options in NAME.args; stdout and the exit code must match
+# NAME.expected. tests/compact.script checks that compact writes heat tiles with the
+# button ids of the live motion they stand for. Then the allocation test streams 1M scripted events through the
+# streaming modes under tests/alloc_count.c and requires the same allocation count
+# as a 1000-event run: nothing may allocate per event after startup.
+# Usage: ./run-tests.sh [path/to/mouse-tool]
+cd "$(dirname "$0")" || exit 2
+MT=${1:-./mouse-tool}
+if [[ ! -x "$MT" ]]; then echo "build mouse-tool first (or pass its path)"; exit 2; fi
+pass=0; fail=0
+for script in tests/scenarios/*.script; do
+    name=${script%.script}
+    eval "set -- $(cat "$name.args")"
+    got=$({ "$MT" --script "$script" "$@"; echo "exit $?"; } 2>&1)
+    if [[ "$got" == "$(cat "$name.expected")" ]]; then
+        pass=$((pass+1))
+    else
+        fail=$((fail+1))
+        echo "FAIL ${name##*/}"
+        diff <(echo "$got") "$name.expected"
+    fi
+done
+echo "scenarios: $pass passed, $fail failed"
+
+tmp=$(mktemp -d); trap 'rm -rf "$tmp"' EXIT
+# compacted motion keeps the (type, button) pairs of live output
+buttons() { grep -o '"button":[0-9]*,"mods":[0-9]*,"type":"[a-z]*"' "$1" | sed 's/"mods":[0-9]*,//' | sort -u; }
+"$MT" --script tests/compact.script -i -l -T > "$tmp/live.jsonl"
+cp "$tmp/live.jsonl" "$tmp/compact.jsonl"
+"$MT" compact --full 5 --coarse 12 --tile 2 "$tmp/compact.jsonl"
+if grep -q '"count"' "$tmp/compact.jsonl" && [[ "$(buttons "$tmp/live.jsonl")" == "$(buttons "$tmp/compact.jsonl")" ]]; then
+    pass=$((pass+1))
+    echo "compact: heat tiles keep live button ids"
+else
+    fail=$((fail+1))
+    echo "FAIL compact: button ids differ from live output"
+    diff <(buttons "$tmp/live.jsonl") <(buttons "$tmp/compact.jsonl")
+fi
+
+# allocation test (needs a C compiler and glibc)
+if ! ${CC:-cc} -shared -fPIC -O2 tests/alloc_count.c -o "$tmp/alloc_count.so" 2>/dev/null; then
+    echo "allocations: skipped (cannot build tests/alloc_count.c)"
+    [[ $fail -eq 0 ]]; exit
+fi
+# N events cycling through press, motion, release, wheel, key and paste
+stream() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; ++i) {
+            x = i % 200 + 1; y = int(i / 200) % 50 + 1; k = i % 8
+            if (k == 0) s = "\\e[<0;" x ";" y "M"
+            else if (k == 1) s = "\\e[<32;" x ";" y "M"
+            else if (k == 2) s = "\\e[<0;" x ";" y "m"
+            else if (k == 3) s = "\\e[<35;" x ";" y "M"
+            else if (k == 4) s = "\\e[<65;" x ";" y "M"
+            else if (k == 5) s = "a"
+            else if (k == 6) s = "\\e[A"
+            else s = "\\e[200~paste\\e[201~"
+            print "+1 " s
+        }
+    }' > "$2"
+}
+stream 1000 "$tmp/small.script"
+stream 1000000 "$tmp/large.script"
+modes=(
+    "-i"
+    "-i -l -T -k"
+    "-i -k --scroll-coalesce 5 --debounce 2"
+    "-i -l -k --filter 'type!=motion && x>=10' --dwell 1,3"
+)
+for mode in "${modes[@]}"; do
+    eval "set -- $mode"
+    counts=()
+    for size in small large; do
+        ALLOC_COUNT_FILE="$tmp/count" LD_PRELOAD="$tmp/alloc_count.so" "$MT" --script "$tmp/$size.script" "$@" > /dev/null 2>&1
+        counts+=("$(cat "$tmp/count" 2>/dev/null)")
+    done
+    if [[ -n "${counts[0]}" && "${counts[0]}" == "${counts[1]}" ]]; then
+        pass=$((pass+1))
+        echo "allocations: $mode: ${counts[0]} at startup, none per event"
+    else
+        fail=$((fail+1))
+        echo "FAIL allocations: $mode: ${counts[0]:-?} with 1000 events, ${counts[1]:-?} with 1000000"
+    fi
+done
+# -j history grows by whole chunks: 1M events need 15 more than the one reserved at startup
+alloc_run() { ALLOC_COUNT_FILE="$tmp/count" LD_PRELOAD="$tmp/alloc_count.so" "$MT" --script "$tmp/$1.script" -i -k -j > /dev/null 2>&1; cat "$tmp/count" 2>/dev/null; }
+small=$(alloc_run small); large=$(alloc_run large)
+if [[ -n "$small" && -n "$large" && $((large - small)) -eq $(( (1000000 + 65535) / 65536 - 1 )) ]]; then
+    pass=$((pass+1))
+    echo "allocations: -i -k -j: $small at startup, $((large - small)) history chunks for 1000000 events"
+else
+    fail=$((fail+1))
+    echo "FAIL allocations: -i -k -j: ${small:-?} with 1000 events, ${large:-?} with 1000000"
+fi
+echo "total: $pass passed, $fail failed"
+[[ $fail -eq 0 ]]